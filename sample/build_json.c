@@ -3,25 +3,81 @@
 #include <stdint.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <zlib.h>
 
 #include "kohnz.h"
 
+// Builds a JSON file of telemetry records.  Every record has the same
+// fields in the same order, so instead of searching for matches each
+// field is written as an lz77 reference to the same field in the record
+// before it (just the name if the value changed).
+//
+// With -b nothing is written to disk.  Instead the same records are
+// encoded in memory with each kind of block libkohnz has and with zlib
+// levels 1 and 6, and throughput, ratio, peak RSS and per record
+// latency are printed for each.
+//
+// Usage: build_json [-n records] [-f fields] [-c change %] [-s seed] [-b]
+
+#define MAX_FIELDS 64
+
 struct _entry
 {
-  const uint8_t *name;
   char value_string[32];
-  int name_length;
   int value_length;
   int value;
-  int new_value;
   uint32_t offset;
 };
 
+struct _records
+{
+  int count;
+  int fields;
+  int change_rate;
+  char names[MAX_FIELDS][32];
+  int name_lengths[MAX_FIELDS];
+  int *values;
+  uint8_t *text;
+  int text_length;
+  // Record n is text[offsets[n]] to text[offsets[n + 1]].
+  int *offsets;
+};
+
+struct _encoder
+{
+  int (*write)(struct _kohnz *kohnz, const uint8_t *data, int length);
+  int (*write_lz77)(struct _kohnz *kohnz, int distance, int length);
+};
+
+struct _result
+{
+  double seconds;
+  uint64_t output_length;
+  uint32_t latency[4];
+  int verified;
+};
+
+enum
+{
+  RUN_FIXED,
+  RUN_DYNAMIC,
+  RUN_HINTED,
+  RUN_AUTO,
+  RUN_MATCHER,
+  RUN_ZLIB_1,
+  RUN_ZLIB_6,
+  RUN_COUNT
+};
+
 // 0: airspeed
 // 1: heading
 // 2: altitude
 // 3: count
 // 4: errors
+// 5+: sensor_05, sensor_06, ...
 
 const char *names[] =
 {
@@ -32,162 +88,717 @@ const char *names[] =
   "    \"errors\": ",
 };
 
-int init_entries(struct _entry *entries)
+const int ranges[][2] =
 {
-  int n;
+  { 300, 4 },
+  { 180, 4 },
+  { 35000, 200 },
+  { 0, 100000 },
+  { 0, 10 },
+};
+
+const char *run_names[] =
+{
+  "fixed",
+  "dynamic",
+  "hinted",
+  "auto",
+  "matcher",
+  "zlib-1",
+  "zlib-6",
+};
 
-  memset(entries, 0, sizeof(struct _entry) * 5);
+static struct _encoder encoders[] =
+{
+  { kohnz_write_fixed, kohnz_write_fixed_lz77 },
+  { kohnz_write_dynamic, kohnz_write_dynamic_lz77 },
+  { kohnz_write_auto, kohnz_write_auto_lz77 },
+};
 
-  entries[0].value = (rand() % 4) + 300;
-  entries[1].value = (rand() % 4) + 180;
-  entries[2].value = (rand() % 200) + 35000;
-  entries[3].value = 0;
-  entries[4].value = 0;
+static uint64_t get_time_ns()
+{
+  struct timespec tp;
 
-  for (n = 0; n < 5; n++)
-  {
-    entries[n].name = (uint8_t *)names[n];
-    entries[n].name_length = strlen(names[n]);
-  }
+  clock_gettime(CLOCK_MONOTONIC, &tp);
 
-  return 0; 
+  return (uint64_t)tp.tv_sec * 1000000000 + tp.tv_nsec;
 }
 
-int update_entries(struct _entry *entries)
+static int format_value(char *s, int value, int field, int fields)
 {
-  entries[0].new_value = (rand() % 4) + 300;
-  entries[1].new_value = (rand() % 4) + 180;
-  entries[2].new_value = (rand() % 200) + 35000;
-  entries[3].new_value++;
-  entries[4].new_value = 0;
-
-  return 0; 
+  if (field < fields - 1)
+  {
+    return sprintf(s, "%d,\n", value);
+  }
+    else
+  {
+    return sprintf(s, "%d\n", value);
+  }
 }
 
-int add_entry(struct _kohnz *kohnz, struct _entry *entries, int last)
+static int generate_records(struct _records *records)
 {
-  int n;
+  const int count = records->count;
+  const int fields = records->fields;
+  int *values;
+  uint8_t *text;
+  int low, range;
+  int n, r;
+
+  for (n = 0; n < fields; n++)
+  {
+    if (n < 5)
+    {
+      strcpy(records->names[n], names[n]);
+    }
+      else
+    {
+      sprintf(records->names[n], "    \"sensor_%02d\": ", n);
+    }
 
-  kohnz_write_fixed(kohnz, (const uint8_t *)"  {\n", 4);
-  kohnz_build_crc32(kohnz, (const uint8_t *)"  {\n", 4);
+    records->name_lengths[n] = strlen(records->names[n]);
+  }
 
-  if (entries[0].offset == 0)
+  records->values = (int *)malloc(sizeof(int) * count * fields);
+  records->offsets = (int *)malloc(sizeof(int) * (count + 1));
+  records->text = (uint8_t *)malloc(count * (8 + fields * 48) + 8);
+
+  if (records->values == NULL ||
+      records->offsets == NULL ||
+      records->text == NULL)
   {
-    // First time entries are logged, so don't bother with lz77.
-    for (n = 0; n < 5; n++)
+    return -1;
+  }
+
+  values = records->values;
+
+  for (r = 0; r < count; r++)
+  {
+    for (n = 0; n < fields; n++)
     {
-      entries[n].offset = kohnz_get_offset(kohnz);
-      kohnz_write_fixed(kohnz,  entries[n].name, entries[n].name_length);
-      kohnz_build_crc32(kohnz,  entries[n].name, entries[n].name_length);
+      low = n < 5 ? ranges[n][0] : 0;
+      range = n < 5 ? ranges[n][1] : 1000;
 
-      if (n < 4)
+      if (r == 0)
       {
-        sprintf(entries[n].value_string, "%d,\n", entries[n].value);
+        values[n] = low + rand() % range;
       }
         else
+      if (rand() % 100 < records->change_rate)
       {
-        sprintf(entries[n].value_string, "%d\n", entries[n].value);
-      }
+        // Always a different value than the last record had.
+        const int last = values[n - fields] - low;
 
-      entries[n].value_length = strlen(entries[n].value_string);
-
-      kohnz_write_fixed(kohnz, (uint8_t *)entries[n].value_string, entries[n].value_length);
-      kohnz_build_crc32(kohnz, (uint8_t *)entries[n].value_string, entries[n].value_length);
+        values[n] = low + (last + 1 + rand() % (range - 1)) % range;
+      }
+        else
+      {
+        values[n] = values[n - fields];
+      }
     }
+
+    values += fields;
   }
-    else
+
+  // The same JSON the lz77 encoders build, for zlib and the matcher.
+  text = records->text;
+  memcpy(text, "[\n", 2);
+  records->text_length = 2;
+  values = records->values;
+
+  for (r = 0; r < count; r++)
   {
-    update_entries(entries);
+    uint8_t *s = text + records->text_length;
+
+    records->offsets[r] = records->text_length;
+
+    memcpy(s, "  {\n", 4);
+    s += 4;
 
-    for (n = 0; n < 5; n++)
+    for (n = 0; n < fields; n++)
     {
-      uint64_t last_offset = entries[n].offset;
+      memcpy(s, records->names[n], records->name_lengths[n]);
+      s += records->name_lengths[n];
+      s += format_value((char *)s, values[n], n, fields);
+    }
 
-      entries[n].offset = kohnz_get_offset(kohnz);
+    if (r != count - 1)
+    {
+      memcpy(s, "  },\n", 5);
+      s += 5;
+    }
+      else
+    {
+      memcpy(s, "  }\n", 4);
+      s += 4;
+    }
 
-      int distance = entries[n].offset - last_offset;
+    records->text_length = s - text;
+    values += fields;
+  }
 
-      if (entries[n].value != entries[n].new_value)
-      {
-        entries[n].value = entries[n].new_value;
-
-        const int length =  entries[n].name_length;
-        kohnz_write_fixed_lz77(kohnz, distance, length);
-        kohnz_build_crc32(kohnz,  entries[n].name, length);
-
-        if (n < 4)
-        {
-          sprintf(entries[n].value_string, "%d,\n", entries[n].value);
-        }
-          else
-        {
-          sprintf(entries[n].value_string, "%d\n", entries[n].value);
-        }
-
-        entries[n].value_length = strlen(entries[n].value_string);
-
-        const uint8_t *value = (const uint8_t *)entries[n].value_string;
-        kohnz_write_fixed(kohnz, value, entries[n].value_length);
-        kohnz_build_crc32(kohnz, value, entries[n].value_length);
-      }
-        else
-      {
-        const int length =  entries[n].name_length +  entries[n].value_length;
-        kohnz_write_fixed_lz77(kohnz, distance, length);
-        kohnz_build_crc32(kohnz, entries[n].name, entries[n].name_length);
-        kohnz_build_crc32(kohnz, (uint8_t *)entries[n].value_string, entries[n].value_length);
-      }
+  records->offsets[count] = records->text_length;
+
+  memcpy(text + records->text_length, "]\n", 2);
+  records->text_length += 2;
+
+  return 0;
+}
+
+static int write_text(
+  struct _kohnz *kohnz,
+  const struct _encoder *encoder,
+  const uint8_t *data,
+  int length)
+{
+  if (encoder->write(kohnz, data, length) != 0) { return -1; }
+
+  return kohnz_build_crc32(kohnz, data, length);
+}
+
+static int add_entry(
+  struct _kohnz *kohnz,
+  const struct _encoder *encoder,
+  struct _entry *entries,
+  const struct _records *records,
+  int record)
+{
+  const int *values = records->values + record * records->fields;
+  const int fields = records->fields;
+  int n;
+
+  write_text(kohnz, encoder, (const uint8_t *)"  {\n", 4);
+
+  for (n = 0; n < fields; n++)
+  {
+    const uint8_t *name = (const uint8_t *)records->names[n];
+    const int name_length = records->name_lengths[n];
+    uint64_t last_offset = entries[n].offset;
+
+    entries[n].offset = kohnz_get_offset(kohnz);
+
+    int distance = entries[n].offset - last_offset;
+
+    if (record == 0 || distance > 32768)
+    {
+      // First time entries are logged, so don't bother with lz77.
+      entries[n].value = values[n];
+      entries[n].value_length =
+        format_value(entries[n].value_string, values[n], n, fields);
+
+      write_text(kohnz, encoder, name, name_length);
+      write_text(
+        kohnz,
+        encoder,
+        (const uint8_t *)entries[n].value_string,
+        entries[n].value_length);
+    }
+      else
+    if (entries[n].value != values[n])
+    {
+      entries[n].value = values[n];
+      entries[n].value_length =
+        format_value(entries[n].value_string, values[n], n, fields);
+
+      encoder->write_lz77(kohnz, distance, name_length);
+      kohnz_build_crc32(kohnz, name, name_length);
+
+      write_text(
+        kohnz,
+        encoder,
+        (const uint8_t *)entries[n].value_string,
+        entries[n].value_length);
+    }
+      else
+    {
+      const int length = name_length + entries[n].value_length;
+
+      encoder->write_lz77(kohnz, distance, length);
+      kohnz_build_crc32(kohnz, name, name_length);
+      kohnz_build_crc32(
+        kohnz,
+        (const uint8_t *)entries[n].value_string,
+        entries[n].value_length);
     }
   }
 
-  if (last == 0)
+  if (record != records->count - 1)
   {
-    kohnz_write_fixed(kohnz, (const uint8_t *)"  },\n", 5);
-    kohnz_build_crc32(kohnz, (const uint8_t *)"  },\n", 5);
+    write_text(kohnz, encoder, (const uint8_t *)"  },\n", 5);
   }
     else
   {
-    kohnz_write_fixed(kohnz, (const uint8_t *)"  }\n", 4);
-    kohnz_build_crc32(kohnz, (const uint8_t *)"  }\n", 4);
+    write_text(kohnz, encoder, (const uint8_t *)"  }\n", 4);
   }
 
   return 0;
 }
 
-int main(int argc, char *argv[])
+static int write_json(const struct _records *records, const char *filename)
 {
   struct _kohnz *kohnz;
-  struct _entry entries[5];
+  struct _entry entries[MAX_FIELDS];
   int n;
 
-  srand(time(NULL));
-  init_entries(entries);
-
-  kohnz_init();
-
-  kohnz = kohnz_open("airplane.json.gz", "airplane.json", NULL);
+  kohnz = kohnz_open(filename, "airplane.json", NULL);
 
   if (kohnz == NULL)
   {
     printf("Couldn't open file for writing\n");
-    return 0;
+    return -1;
   }
 
+  memset(entries, 0, sizeof(entries));
+
   kohnz_start_fixed_block(kohnz, 1);
 
-  kohnz_write_fixed(kohnz, (const uint8_t *)"[\n", 2);
-  kohnz_build_crc32(kohnz, (const uint8_t *)"[\n", 2);
+  write_text(kohnz, &encoders[0], (const uint8_t *)"[\n", 2);
 
-  for (n = 0; n < 1000; n++)
+  for (n = 0; n < records->count; n++)
   {
-    add_entry(kohnz, entries, n == 999);
+    add_entry(kohnz, &encoders[0], entries, records, n);
   }
 
-  kohnz_write_fixed(kohnz, (const uint8_t *)"]\n", 2);
-  kohnz_build_crc32(kohnz, (const uint8_t *)"]\n", 2);
+  write_text(kohnz, &encoders[0], (const uint8_t *)"]\n", 2);
+
   kohnz_end_fixed_block(kohnz);
   kohnz_close(kohnz);
 
   return 0;
 }
 
+static void sort_symbols(
+  uint16_t *sorted,
+  const uint32_t *counts,
+  int count)
+{
+  int i, j;
+
+  // Most used first.  Every symbol is listed so any of them can still
+  // be written, the ones that weren't seen just get the longest codes.
+  for (i = 0; i < count; i++)
+  {
+    const uint16_t symbol = i;
+
+    for (j = i; j > 0 && counts[sorted[j - 1]] < counts[symbol]; j--)
+    {
+      sorted[j] = sorted[j - 1];
+    }
+
+    sorted[j] = symbol;
+  }
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+  const uint32_t x = *(const uint32_t *)a;
+  const uint32_t y = *(const uint32_t *)b;
+
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static void get_percentiles(struct _result *result, uint32_t *latency, int count)
+{
+  qsort(latency, count, sizeof(uint32_t), compare_latency);
+
+  result->latency[0] = latency[count * 50 / 100];
+  result->latency[1] = latency[count * 90 / 100];
+  result->latency[2] = latency[count * 99 / 100];
+  result->latency[3] = latency[count - 1];
+}
+
+static int verify(const struct _records *records, const uint8_t *data, int length)
+{
+  z_stream stream;
+  uint8_t *text;
+  int ret;
+
+  text = (uint8_t *)malloc(records->text_length + 1);
+
+  if (text == NULL) { return 0; }
+
+  memset(&stream, 0, sizeof(stream));
+  inflateInit2(&stream, -15);
+
+  stream.next_in = (uint8_t *)data;
+  stream.avail_in = length;
+  stream.next_out = text;
+  stream.avail_out = records->text_length + 1;
+
+  ret = inflate(&stream, Z_FINISH);
+
+  ret = ret == Z_STREAM_END &&
+        stream.total_out == records->text_length &&
+        memcmp(text, records->text, records->text_length) == 0;
+
+  inflateEnd(&stream);
+  free(text);
+
+  return ret;
+}
+
+static int run_kohnz(
+  const struct _records *records,
+  int mode,
+  struct _result *result,
+  uint32_t *latency)
+{
+  const struct _encoder *encoder;
+  struct _kohnz *kohnz;
+  struct _kohnz_histogram histogram;
+  struct _kohnz_table table;
+  struct _entry entries[MAX_FIELDS];
+  uint16_t literals_sorted[286];
+  uint16_t distances_sorted[30];
+  uint64_t start, record_start;
+  const uint8_t *output;
+  int sample_count;
+  int length;
+  int n;
+
+  memset(entries, 0, sizeof(entries));
+
+  // Dynamic tables are trained on the first 100 records, which counts
+  // as setup and isn't timed.
+  sample_count = records->count < 100 ? records->count : 100;
+
+  if (mode == RUN_DYNAMIC || mode == RUN_HINTED)
+  {
+    kohnz_histogram_init(&histogram);
+    kohnz_histogram_add_sample(
+      &histogram,
+      records->text,
+      records->offsets[sample_count]);
+
+    kohnz_table_build(&table, &histogram);
+    sort_symbols(literals_sorted, histogram.literals, 286);
+    sort_symbols(distances_sorted, histogram.distances, 30);
+  }
+
+  kohnz = kohnz_open_memory();
+
+  if (kohnz == NULL) { return -1; }
+
+  start = get_time_ns();
+
+  switch (mode)
+  {
+    case RUN_FIXED:
+      kohnz_start_fixed_block(kohnz, 1);
+      encoder = &encoders[0];
+      break;
+    case RUN_DYNAMIC:
+      kohnz_start_dynamic_block_table(kohnz, 1, &table);
+      encoder = &encoders[1];
+      break;
+    case RUN_HINTED:
+      kohnz_start_dynamic_block(
+        kohnz,
+        1,
+        literals_sorted,
+        distances_sorted,
+        286,
+        30);
+      encoder = &encoders[1];
+      break;
+    default:
+      kohnz_start_auto_block(kohnz, 1);
+      encoder = &encoders[2];
+      break;
+  }
+
+  if (mode == RUN_MATCHER)
+  {
+    kohnz_compress(kohnz, records->text, 2);
+
+    for (n = 0; n < records->count; n++)
+    {
+      const int offset = records->offsets[n];
+
+      record_start = get_time_ns();
+
+      kohnz_compress(
+        kohnz,
+        records->text + offset,
+        records->offsets[n + 1] - offset);
+
+      latency[n] = get_time_ns() - record_start;
+    }
+
+    kohnz_compress(kohnz, records->text + records->text_length - 2, 2);
+  }
+    else
+  {
+    write_text(kohnz, encoder, (const uint8_t *)"[\n", 2);
+
+    for (n = 0; n < records->count; n++)
+    {
+      record_start = get_time_ns();
+
+      add_entry(kohnz, encoder, entries, records, n);
+
+      latency[n] = get_time_ns() - record_start;
+    }
+
+    write_text(kohnz, encoder, (const uint8_t *)"]\n", 2);
+  }
+
+  switch (mode)
+  {
+    case RUN_FIXED: kohnz_end_fixed_block(kohnz); break;
+    case RUN_DYNAMIC: kohnz_end_dynamic_block(kohnz); break;
+    case RUN_HINTED: kohnz_end_dynamic_block(kohnz); break;
+    default: kohnz_end_auto_block(kohnz); break;
+  }
+
+  result->seconds = (double)(get_time_ns() - start) / 1000000000;
+
+  output = kohnz_get_memory(kohnz, &length);
+
+  result->output_length = length;
+  result->verified = verify(records, output, length);
+
+  kohnz_close(kohnz);
+
+  return 0;
+}
+
+static int run_zlib(
+  const struct _records *records,
+  int level,
+  struct _result *result,
+  uint32_t *latency)
+{
+  z_stream stream;
+  uint64_t start, record_start;
+  uint8_t *output;
+  int length;
+  int n;
+
+  // Raw deflate, the same as what the kohnz memory contexts hold.
+  memset(&stream, 0, sizeof(stream));
+
+  if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+  {
+    return -1;
+  }
+
+  length = deflateBound(&stream, records->text_length);
+  output = (uint8_t *)malloc(length);
+
+  if (output == NULL) { return -1; }
+
+  stream.next_out = output;
+  stream.avail_out = length;
+
+  start = get_time_ns();
+
+  stream.next_in = records->text;
+  stream.avail_in = 2;
+  deflate(&stream, Z_NO_FLUSH);
+
+  for (n = 0; n < records->count; n++)
+  {
+    const int offset = records->offsets[n];
+
+    record_start = get_time_ns();
+
+    stream.next_in = records->text + offset;
+    stream.avail_in = records->offsets[n + 1] - offset;
+    deflate(&stream, Z_NO_FLUSH);
+
+    latency[n] = get_time_ns() - record_start;
+  }
+
+  stream.next_in = records->text + records->text_length - 2;
+  stream.avail_in = 2;
+  deflate(&stream, Z_FINISH);
+
+  result->seconds = (double)(get_time_ns() - start) / 1000000000;
+  result->output_length = stream.total_out;
+  result->verified = verify(records, output, stream.total_out);
+
+  deflateEnd(&stream);
+  free(output);
+
+  return 0;
+}
+
+static int run_mode(const struct _records *records, int mode, struct _result *result)
+{
+  uint32_t *latency;
+  int ret;
+
+  latency = (uint32_t *)malloc(sizeof(uint32_t) * records->count);
+
+  if (latency == NULL) { return -1; }
+
+  memset(result, 0, sizeof(struct _result));
+
+  if (mode == RUN_ZLIB_1 || mode == RUN_ZLIB_6)
+  {
+    ret = run_zlib(records, mode == RUN_ZLIB_1 ? 1 : 6, result, latency);
+  }
+    else
+  {
+    ret = run_kohnz(records, mode, result, latency);
+  }
+
+  if (ret == 0) { get_percentiles(result, latency, records->count); }
+
+  free(latency);
+
+  return ret;
+}
+
+static int benchmark(const struct _records *records)
+{
+  struct _result result;
+  struct rusage usage;
+  int fds[2];
+  int status;
+  pid_t pid;
+  int mode;
+
+  printf("records=%d fields=%d change=%d%% input=%d\n",
+    records->count,
+    records->fields,
+    records->change_rate,
+    records->text_length);
+
+  printf("%-8s %10s %7s %9s %8s %8s %8s %8s %s\n",
+    "mode", "MB/s", "ratio", "rss_kb",
+    "p50_ns", "p90_ns", "p99_ns", "max_ns", "verified");
+
+  for (mode = 0; mode < RUN_COUNT; mode++)
+  {
+    // Each mode runs in its own process so peak RSS is only for that
+    // mode (plus the input records, which are the same for all).
+    if (pipe(fds) != 0) { return -1; }
+
+    fflush(stdout);
+
+    pid = fork();
+
+    if (pid < 0) { return -1; }
+
+    if (pid == 0)
+    {
+      close(fds[0]);
+
+      if (run_mode(records, mode, &result) != 0) { _exit(1); }
+
+      if (write(fds[1], &result, sizeof(result)) != sizeof(result))
+      {
+        _exit(1);
+      }
+
+      _exit(0);
+    }
+
+    close(fds[1]);
+
+    memset(&result, 0, sizeof(result));
+
+    if (read(fds[0], &result, sizeof(result)) != sizeof(result))
+    {
+      printf("%-8s failed\n", run_names[mode]);
+    }
+
+    close(fds[0]);
+
+    wait4(pid, &status, 0, &usage);
+
+    if (result.seconds == 0) { continue; }
+
+    printf("%-8s %10.1f %7.3f %9ld %8u %8u %8u %8u %s\n",
+      run_names[mode],
+      ((double)records->text_length / (1024 * 1024)) / result.seconds,
+      (double)result.output_length / records->text_length,
+      usage.ru_maxrss,
+      result.latency[0],
+      result.latency[1],
+      result.latency[2],
+      result.latency[3],
+      result.verified ? "yes" : "NO");
+  }
+
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  struct _records records;
+  int do_benchmark = 0;
+  int seed = 1;
+  int n;
+
+  memset(&records, 0, sizeof(records));
+  records.count = 1000;
+  records.fields = 5;
+  records.change_rate = 50;
+
+  for (n = 1; n < argc; n++)
+  {
+    if (strcmp(argv[n], "-b") == 0)
+    {
+      do_benchmark = 1;
+    }
+      else
+    if (n + 1 < argc && strcmp(argv[n], "-n") == 0)
+    {
+      records.count = atoi(argv[++n]);
+    }
+      else
+    if (n + 1 < argc && strcmp(argv[n], "-f") == 0)
+    {
+      records.fields = atoi(argv[++n]);
+    }
+      else
+    if (n + 1 < argc && strcmp(argv[n], "-c") == 0)
+    {
+      records.change_rate = atoi(argv[++n]);
+    }
+      else
+    if (n + 1 < argc && strcmp(argv[n], "-s") == 0)
+    {
+      seed = atoi(argv[++n]);
+    }
+      else
+    {
+      printf("Usage: %s [-n records] [-f fields] [-c change %%] [-s seed] [-b]\n",
+        argv[0]);
+      return 0;
+    }
+  }
+
+  if (records.count < 1 || records.fields < 1 || records.fields > MAX_FIELDS)
+  {
+    printf("Error: records must be at least 1 and fields 1 to %d\n", MAX_FIELDS);
+    return -1;
+  }
+
+  srand(seed);
+
+  if (generate_records(&records) != 0)
+  {
+    printf("Error: out of memory\n");
+    return -1;
+  }
+
+  if (do_benchmark == 1)
+  {
+    benchmark(&records);
+  }
+    else
+  {
+    write_json(&records, "airplane.json.gz");
+  }
+
+  free(records.values);
+  free(records.offsets);
+  free(records.text);
+
+  return 0;
+}
+
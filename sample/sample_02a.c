@@ -8,8 +8,8 @@ int main(int argc, char *argv[])
 {
   struct _kohnz *kohnz;
   uint8_t buffer[32];
-  uint16_t literals_sorted[285] = { ',', '1', '2', '9' };
-  uint16_t distances_sorted[32];
+  uint16_t literals_sorted[4 + 1 + (285 - 257 + 1)] = { ',', '1', '2', '9', 256 };
+  uint16_t distances_sorted[30];
   int n;
 
   kohnz_init();
@@ -24,14 +24,11 @@ int main(int argc, char *argv[])
 
   sprintf((char *)buffer, "129,129,129,129");
 
-  const int length = sizeof(buffer) - 1;
-
-  memset(literals_sorted, 0, sizeof(literals_sorted));
-  memset(distances_sorted, 0, sizeof(distances_sorted));
+  const int length = strlen((char *)buffer);
 
   int code = 257;
 
-  for (n = 4; n <= 4 + (285 - 257); n++)
+  for (n = 5; n <= 5 + (285 - 257); n++)
   {
     literals_sorted[n] = code++;
   }
@@ -0,0 +1,95 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ * An example of several threads writing records to the same .gz file.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "kohnz.h"
+
+#define THREADS 4
+#define RECORDS 1000
+
+struct _thread_info
+{
+  struct _kohnz_shared *shared;
+  int id;
+};
+
+void *write_records(void *context)
+{
+  struct _thread_info *thread_info = (struct _thread_info *)context;
+  struct _kohnz *record;
+  char text[64];
+  int n, length;
+
+  // Each thread encodes its records into its own memory context and
+  // hands them to the shared writer when they are complete.
+  record = kohnz_open_memory();
+
+  for (n = 0; n < RECORDS; n++)
+  {
+    sprintf(text, "thread=%d record=%d\nthread=%d record=%d\n",
+      thread_info->id, n, thread_info->id, n);
+
+    length = strlen(text) / 2;
+
+    // Distances can only point inside of the record.
+    kohnz_start_fixed_block(record, 0);
+    kohnz_write_fixed(record, (const uint8_t *)text, length);
+    kohnz_write_fixed_lz77(record, length, length);
+    kohnz_end_fixed_block(record);
+    kohnz_build_crc32(record, (const uint8_t *)text, length * 2);
+
+    kohnz_shared_commit(thread_info->shared, record);
+  }
+
+  kohnz_close(record);
+
+  return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+  struct _kohnz_shared *shared;
+  struct _thread_info thread_info[THREADS];
+  pthread_t threads[THREADS];
+  int n;
+
+  shared = kohnz_shared_open("records.txt.gz", "records.txt", NULL, 0);
+
+  if (shared == NULL)
+  {
+    printf("Couldn't open file for writing\n");
+    return 0;
+  }
+
+  for (n = 0; n < THREADS; n++)
+  {
+    thread_info[n].shared = shared;
+    thread_info[n].id = n;
+
+    pthread_create(&threads[n], NULL, write_records, &thread_info[n]);
+  }
+
+  for (n = 0; n < THREADS; n++)
+  {
+    pthread_join(threads[n], NULL);
+  }
+
+  kohnz_shared_close(shared);
+
+  return 0;
+}
+
@@ -0,0 +1,53 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ * An example of creating a zlib stream with a preset dictionary.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kohnz.h"
+
+int main(int argc, char *argv[])
+{
+  struct _kohnz *kohnz;
+  const char *dictionary = "{\"name\": \"\", \"value\": }";
+  const char *text = "{\"name\": \"MIKE\", \"value\": 4}";
+
+  kohnz = kohnz_open_container("mikemike.z", KOHNZ_CONTAINER_ZLIB, NULL, NULL);
+
+  if (kohnz == NULL)
+  {
+    printf("Couldn't open file for writing\n");
+    return 0;
+  }
+
+  // The decompressor needs to be given the same dictionary.
+  kohnz_set_dictionary(kohnz, (const uint8_t *)dictionary, strlen(dictionary));
+
+  // The first 10 bytes ({"name": ") are at the start of the dictionary,
+  // 23 bytes back.  After the name, the 12 bytes (", "value": ) are at
+  // dictionary offset 10, which is 23 + 14 - 10 = 27 bytes back.
+  kohnz_start_fixed_block(kohnz, 1);
+  kohnz_write_fixed_lz77(kohnz, 23, 10);
+  kohnz_write_fixed(kohnz, (const uint8_t *)"MIKE", 4);
+  kohnz_write_fixed_lz77(kohnz, 27, 12);
+  kohnz_write_fixed(kohnz, (const uint8_t *)"4}", 2);
+  kohnz_end_fixed_block(kohnz);
+
+  kohnz_build_crc32(kohnz, (const uint8_t *)text, strlen(text));
+
+  kohnz_close(kohnz);
+
+  return 0;
+}
+
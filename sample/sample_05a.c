@@ -0,0 +1,153 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ * An example of a logger that checkpoints its output so it can pick up
+ * where it left off after it's killed.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "kohnz.h"
+
+#define RECORD_COUNT 1000
+#define CHECKPOINT_EVERY 300
+
+static int write_record(struct _kohnz *kohnz, int index)
+{
+  char record[128];
+  int length;
+
+  length = snprintf(record, sizeof(record),
+    "%06d sensor=%d temperature=%d\n", index, index % 4, 20 + (index % 7));
+
+  return kohnz_compress(kohnz, (const uint8_t *)record, length);
+}
+
+static int save_checkpoint(struct _kohnz *kohnz, int next_record)
+{
+  struct _kohnz_checkpoint checkpoint;
+  uint8_t blob[KOHNZ_CHECKPOINT_SIZE];
+  FILE *out;
+
+  if (kohnz_checkpoint(kohnz, &checkpoint) != 0) { return -1; }
+
+  kohnz_checkpoint_save(&checkpoint, blob, sizeof(blob));
+
+  // Written to a temporary file and renamed so there is always one
+  // complete checkpoint on disk.  The logger also has to remember which
+  // record comes next.
+  out = fopen("log.ckpt.tmp", "wb");
+
+  if (out == NULL) { return -1; }
+
+  fwrite(blob, 1, sizeof(blob), out);
+  fwrite(&next_record, 1, sizeof(next_record), out);
+  fflush(out);
+  fsync(fileno(out));
+  fclose(out);
+
+  return rename("log.ckpt.tmp", "log.ckpt");
+}
+
+static struct _kohnz *resume(int *next_record)
+{
+  struct _kohnz_checkpoint checkpoint;
+  uint8_t blob[KOHNZ_CHECKPOINT_SIZE];
+  FILE *in;
+  int ok;
+
+  in = fopen("log.ckpt", "rb");
+
+  if (in == NULL) { return NULL; }
+
+  ok = fread(blob, 1, sizeof(blob), in) == sizeof(blob) &&
+       fread(next_record, 1, sizeof(int), in) == sizeof(int);
+
+  fclose(in);
+
+  if (!ok || kohnz_checkpoint_load(&checkpoint, blob, sizeof(blob)) != 0)
+  {
+    return NULL;
+  }
+
+  return kohnz_resume("log.txt.gz", &checkpoint);
+}
+
+static void run_until_crash()
+{
+  struct _kohnz *kohnz;
+  int n;
+
+  kohnz = kohnz_open("log.txt.gz", "log.txt", NULL);
+
+  if (kohnz == NULL) { _exit(1); }
+
+  kohnz_start_fixed_block(kohnz, 0);
+
+  for (n = 0; n < RECORD_COUNT / 2; n++)
+  {
+    if (n != 0 && n % CHECKPOINT_EVERY == 0)
+    {
+      if (save_checkpoint(kohnz, n) != 0) { _exit(1); }
+    }
+
+    write_record(kohnz, n);
+  }
+
+  // Some of what was written after the checkpoint makes it to disk,
+  // then the process dies without closing the file.
+  kohnz_flush(kohnz, KOHNZ_FLUSH_SYNC);
+
+  _exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+  struct _kohnz *kohnz;
+  int next_record, n;
+  pid_t pid;
+
+  unlink("log.ckpt");
+
+  pid = fork();
+
+  if (pid == 0) { run_until_crash(); }
+
+  waitpid(pid, NULL, 0);
+
+  kohnz = resume(&next_record);
+
+  if (kohnz == NULL)
+  {
+    printf("Couldn't resume from the checkpoint\n");
+    return -1;
+  }
+
+  printf("Resuming at record %d\n", next_record);
+
+  // Blocks aren't part of the checkpoint, so a new one is started.
+  kohnz_start_fixed_block(kohnz, 0);
+
+  for (n = next_record; n < RECORD_COUNT; n++)
+  {
+    write_record(kohnz, n);
+  }
+
+  kohnz_close(kohnz);
+
+  unlink("log.ckpt");
+
+  return 0;
+}
+
@@ -0,0 +1,160 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ * Mixes kohnz_compress() with kohnz_write_fixed(), kohnz_append() and
+ * kohnz_compress_parallel() in one stream at each level and checks the
+ * result with zlib.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "kohnz.h"
+
+#define PART_SIZE 100000
+#define PARALLEL_SIZE 300000
+#define TOTAL_SIZE (PART_SIZE * 6 + PARALLEL_SIZE)
+
+static uint8_t expected[TOTAL_SIZE];
+static uint8_t result[TOTAL_SIZE + 1];
+
+static void build_text(uint8_t *data, int length, int seed)
+{
+  char line[128];
+  int count, n = 0;
+
+  while (n < length)
+  {
+    count = snprintf(line, sizeof(line),
+      "%06d sensor=%d temperature=%d status=%s\n",
+      seed, seed % 4, 20 + (seed % 7), (seed % 5) == 0 ? "alarm" : "ok");
+
+    if (count > length - n) { count = length - n; }
+
+    memcpy(data + n, line, count);
+    n += count;
+    seed += 3;
+  }
+}
+
+static int write_segment(struct _kohnz *kohnz, const uint8_t *data, int length)
+{
+  struct _kohnz *segment;
+  int ret = 0;
+
+  segment = kohnz_open_memory();
+
+  if (segment == NULL) { return -1; }
+
+  kohnz_start_fixed_block(segment, 0);
+  if (kohnz_compress(segment, data, length) != 0) { ret = -1; }
+  kohnz_end_fixed_block(segment);
+
+  if (kohnz_append(kohnz, segment) != 0) { ret = -1; }
+
+  kohnz_close(segment);
+
+  return ret;
+}
+
+static int write_mixed(const char *filename, int level)
+{
+  struct _kohnz *kohnz;
+  const uint8_t *data = expected;
+  int ret = 0;
+
+  kohnz = kohnz_open(filename, "mixed.txt", NULL);
+
+  if (kohnz == NULL) { return -1; }
+
+  kohnz_set_level(kohnz, level);
+
+  // Literals written straight to the block between two compress calls.
+  kohnz_start_fixed_block(kohnz, 0);
+  if (kohnz_compress(kohnz, data, PART_SIZE) != 0) { ret = -1; }
+  data += PART_SIZE;
+  if (kohnz_write_fixed(kohnz, data, PART_SIZE) != 0) { ret = -1; }
+  kohnz_build_crc32(kohnz, data, PART_SIZE);
+  data += PART_SIZE;
+  if (kohnz_compress(kohnz, data, PART_SIZE) != 0) { ret = -1; }
+  data += PART_SIZE;
+  kohnz_end_fixed_block(kohnz);
+
+  // Chunks compressed on other threads and spliced in.
+  if (kohnz_compress_parallel(kohnz, data, PARALLEL_SIZE, 2, 65536) != 0)
+  {
+    ret = -1;
+  }
+
+  data += PARALLEL_SIZE;
+
+  kohnz_start_fixed_block(kohnz, 0);
+  if (kohnz_compress(kohnz, data, PART_SIZE) != 0) { ret = -1; }
+  data += PART_SIZE;
+  kohnz_end_fixed_block(kohnz);
+
+  // A segment built in a memory context.
+  if (write_segment(kohnz, data, PART_SIZE) != 0) { ret = -1; }
+  data += PART_SIZE;
+
+  kohnz_start_fixed_block(kohnz, 1);
+  if (kohnz_compress(kohnz, data, PART_SIZE) != 0) { ret = -1; }
+  kohnz_end_fixed_block(kohnz);
+
+  if (kohnz_close(kohnz) != 0) { ret = -1; }
+
+  return ret;
+}
+
+static int check_mixed(const char *filename)
+{
+  gzFile in;
+  int length;
+
+  in = gzopen(filename, "rb");
+
+  if (in == NULL) { return -1; }
+
+  length = gzread(in, result, sizeof(result));
+
+  gzclose(in);
+
+  if (length != TOTAL_SIZE) { return -1; }
+  if (memcmp(result, expected, TOTAL_SIZE) != 0) { return -1; }
+
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  const char *filename = "mixed.txt.gz";
+  int failed = 0;
+  int level;
+
+  build_text(expected, TOTAL_SIZE, 0);
+
+  for (level = KOHNZ_LEVEL_FAST; level <= KOHNZ_LEVEL_OPTIMAL; level++)
+  {
+    if (write_mixed(filename, level) != 0 || check_mixed(filename) != 0)
+    {
+      printf("level %d: FAIL\n", level);
+      failed = 1;
+    }
+      else
+    {
+      printf("level %d: ok\n", level);
+    }
+  }
+
+  return failed;
+}
+
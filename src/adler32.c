@@ -0,0 +1,126 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ */
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "adler32.h"
+
+#define BASE 65521
+
+// Largest number of bytes that can be summed before s2 could overflow
+// 32 bits (see RFC1950).  This is a multiple of 16 for the SSE2 loop.
+#define NMAX 5552
+
+#ifdef __SSE2__
+static void adler32_sse2(
+  const uint8_t *buffer,
+  int len,
+  uint32_t *s1,
+  uint32_t *s2)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i weights_lo = _mm_set_epi16(9, 10, 11, 12, 13, 14, 15, 16);
+  const __m128i weights_hi = _mm_set_epi16(1, 2, 3, 4, 5, 6, 7, 8);
+  uint32_t sums[4];
+
+  // len is a multiple of 16.  For each 16 bytes s1 gets the sum of the
+  // bytes and s2 gets 16 * s1 (from before the bytes) plus each byte
+  // times its distance from the end.  The s1 from before each block is
+  // collected in prefix and multiplied by 16 at the end.
+  __m128i vs1 = zero;
+  __m128i vs2 = zero;
+  __m128i prefix = zero;
+  const int blocks = len / 16;
+  int n;
+
+  for (n = 0; n < blocks; n++)
+  {
+    const __m128i data = _mm_loadu_si128((const __m128i *)buffer);
+    const __m128i lo = _mm_unpacklo_epi8(data, zero);
+    const __m128i hi = _mm_unpackhi_epi8(data, zero);
+
+    prefix = _mm_add_epi32(prefix, vs1);
+    vs1 = _mm_add_epi32(vs1, _mm_sad_epu8(data, zero));
+    vs2 = _mm_add_epi32(vs2, _mm_madd_epi16(lo, weights_lo));
+    vs2 = _mm_add_epi32(vs2, _mm_madd_epi16(hi, weights_hi));
+
+    buffer += 16;
+  }
+
+  vs2 = _mm_add_epi32(vs2, _mm_slli_epi32(prefix, 4));
+
+  _mm_storeu_si128((__m128i *)sums, vs2);
+  *s2 += (uint32_t)blocks * 16 * *s1;
+  *s2 += sums[0] + sums[1] + sums[2] + sums[3];
+
+  _mm_storeu_si128((__m128i *)sums, vs1);
+  *s1 += sums[0] + sums[2];
+}
+#endif
+
+uint32_t kohnz_adler32(const uint8_t *buffer, int len, uint32_t adler)
+{
+  uint32_t s1 = adler & 0xffff;
+  uint32_t s2 = adler >> 16;
+  int count, n;
+
+  while (len > 0)
+  {
+    count = len < NMAX ? len : NMAX;
+    len -= count;
+
+#ifdef __SSE2__
+    const int vector_count = count & ~15;
+
+    adler32_sse2(buffer, vector_count, &s1, &s2);
+
+    buffer += vector_count;
+    count -= vector_count;
+#endif
+
+    for (n = 0; n < count; n++)
+    {
+      s1 += buffer[n];
+      s2 += s1;
+    }
+
+    buffer += count;
+
+    s1 %= BASE;
+    s2 %= BASE;
+  }
+
+  return (s2 << 16) | s1;
+}
+
+uint32_t kohnz_adler32_combine(uint32_t adler1, uint32_t adler2, uint64_t length2)
+{
+  const uint32_t rem = length2 % BASE;
+  uint32_t sum1, sum2;
+
+  // s1 of the combined data is just the two s1's added (the initial 1 in
+  // adler2 is taken back out).  s2 also picks up s1 of the first part
+  // once for every byte of the second part.
+  sum1 = adler1 & 0xffff;
+  sum2 = (rem * sum1) % BASE;
+  sum1 += (adler2 & 0xffff) + BASE - 1;
+  sum2 += (adler1 >> 16) + (adler2 >> 16) + BASE - rem;
+
+  if (sum1 >= BASE) { sum1 -= BASE; }
+  if (sum1 >= BASE) { sum1 -= BASE; }
+  if (sum2 >= (BASE << 1)) { sum2 -= (BASE << 1); }
+  if (sum2 >= BASE) { sum2 -= BASE; }
+
+  return (sum2 << 16) | sum1;
+}
+
@@ -0,0 +1,21 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ */
+
+#ifndef _ADLER32_H
+#define _ADLER32_H
+
+#include <stdint.h>
+
+uint32_t kohnz_adler32(const uint8_t *buffer, int len, uint32_t adler);
+uint32_t kohnz_adler32_combine(uint32_t adler1, uint32_t adler2, uint64_t length2);
+
+#endif
+
@@ -0,0 +1,88 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "alloc.h"
+#include "kohnz.h"
+
+static void *default_alloc(size_t size, void *context)
+{
+  return malloc(size);
+}
+
+static void default_free(void *ptr, void *context)
+{
+  free(ptr);
+}
+
+// The allocator new contexts get.  A context keeps a copy of it from
+// when it was opened, so everything it allocates is freed the same way
+// even if this is changed while it's open.
+static struct _kohnz_allocator default_allocator =
+{
+  default_alloc,
+  default_free,
+  NULL
+};
+
+static pthread_mutex_t default_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void kohnz_allocator_get(struct _kohnz_allocator *allocator)
+{
+  pthread_mutex_lock(&default_lock);
+  *allocator = default_allocator;
+  pthread_mutex_unlock(&default_lock);
+}
+
+void *kohnz_alloc(const struct _kohnz_allocator *allocator, size_t size)
+{
+  return allocator->alloc(size, allocator->context);
+}
+
+void kohnz_free(const struct _kohnz_allocator *allocator, void *ptr)
+{
+  if (ptr == NULL) { return; }
+
+  allocator->free(ptr, allocator->context);
+}
+
+int kohnz_allocator_equal(
+  const struct _kohnz_allocator *a,
+  const struct _kohnz_allocator *b)
+{
+  return a->alloc == b->alloc && a->free == b->free && a->context == b->context;
+}
+
+void kohnz_set_allocator(
+  void *(*alloc)(size_t size, void *context),
+  void (*free)(void *ptr, void *context),
+  void *context)
+{
+  pthread_mutex_lock(&default_lock);
+
+  if (alloc == NULL || free == NULL)
+  {
+    default_allocator.alloc = default_alloc;
+    default_allocator.free = default_free;
+    default_allocator.context = NULL;
+  }
+    else
+  {
+    default_allocator.alloc = alloc;
+    default_allocator.free = free;
+    default_allocator.context = context;
+  }
+
+  pthread_mutex_unlock(&default_lock);
+}
@@ -0,0 +1,33 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ */
+
+#ifndef _ALLOC_H
+#define _ALLOC_H
+
+#include <stdlib.h>
+
+#include "kohnz.h"
+
+void kohnz_allocator_get(struct _kohnz_allocator *allocator);
+void *kohnz_alloc(const struct _kohnz_allocator *allocator, size_t size);
+void kohnz_free(const struct _kohnz_allocator *allocator, void *ptr);
+
+// A memory context that allocates through allocator (or the one
+// installed right now if it's NULL).  For contexts the library opens
+// for its own use, so they match the context they're working for.
+struct _kohnz *kohnz_open_memory_with(const struct _kohnz_allocator *allocator);
+
+int kohnz_allocator_equal(
+  const struct _kohnz_allocator *a,
+  const struct _kohnz_allocator *b);
+
+#endif
+
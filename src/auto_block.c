@@ -0,0 +1,392 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "auto_block.h"
+#include "deflate_codes.h"
+#include "dynamic_huffman.h"
+#include "fileio.h"
+#include "stats.h"
+
+// A token is either a literal byte or, with the top bit set, a match
+// with the length in bits 16 to 24 and distance - 1 in the bottom 16.
+#define TOKEN_MATCH 0x80000000
+
+// log2(1 + n / 64) in 1/256 bits.
+static const uint8_t log2_fraction[64] =
+{
+    0,   6,  11,  17,  22,  28,  33,  38,  44,  49,  54,  59,  63,
+   68,  73,  78,  82,  87,  92,  96, 100, 105, 109, 113, 118, 122,
+  126, 130, 134, 138, 142, 146, 150, 154, 157, 161, 165, 169, 172,
+  176, 179, 183, 186, 190, 193, 197, 200, 203, 207, 210, 213, 216,
+  220, 223, 226, 229, 232, 235, 238, 241, 244, 247, 250, 253
+};
+
+// log2(x) in 1/256 bits, using the 6 bits under the top one to look up
+// the fraction.
+static inline uint32_t log2_fixed(uint32_t x)
+{
+  const int msb = 31 - __builtin_clz(x);
+  int index;
+
+  if (msb >= 6)
+  {
+    index = (x >> (msb - 6)) & 0x3f;
+  }
+    else
+  {
+    index = (x << (6 - msb)) & 0x3f;
+  }
+
+  return (msb << 8) + log2_fraction[index];
+}
+
+// Estimated bits (in 1/256 bits) to code the symbols with a table built
+// just for them.  The second set of counts is added in if it's not NULL.
+static uint64_t entropy_cost(
+  const uint32_t *counts_a,
+  const uint32_t *counts_b,
+  int length)
+{
+  uint64_t total = 0;
+  uint64_t cost = 0;
+  int n;
+
+  for (n = 0; n < length; n++)
+  {
+    const uint32_t count = counts_a[n] + (counts_b != NULL ? counts_b[n] : 0);
+
+    if (count == 0) { continue; }
+
+    total += count;
+    cost += (uint64_t)count * log2_fixed(count);
+  }
+
+  if (total == 0) { return 0; }
+
+  return total * log2_fixed(total) - cost;
+}
+
+static uint64_t header_estimate(const uint32_t *literals, const uint32_t *distances)
+{
+  int used = 0;
+  int n;
+
+  for (n = 0; n < 286; n++) { used += literals[n] != 0; }
+  for (n = 0; n < 30; n++) { used += distances[n] != 0; }
+
+  return (uint64_t)(70 + used * 5) << 8;
+}
+
+static uint64_t table_cost(
+  const struct _kohnz_table *table,
+  const uint32_t *literals,
+  const uint32_t *distances)
+{
+  uint64_t cost = 0;
+  int n;
+
+  for (n = 0; n < 286; n++)
+  {
+    cost += (uint64_t)literals[n] * table->literals[n].length;
+  }
+
+  for (n = 0; n < 30; n++)
+  {
+    cost += (uint64_t)distances[n] * table->distances[n].length;
+  }
+
+  return cost;
+}
+
+static void write_tokens(
+  struct _kohnz *kohnz,
+  const struct _kohnz_table *table,
+  const uint32_t *tokens,
+  int count)
+{
+  const struct _huffman *huffman;
+  int n;
+
+  for (n = 0; n < count; n++)
+  {
+    const uint32_t token = tokens[n];
+
+    if ((token & TOKEN_MATCH) == 0)
+    {
+      huffman = &table->literals[token];
+      write_bits(kohnz, huffman->code, huffman->length);
+
+      STATS_ADD(kohnz, literals, 1);
+      STATS_ADD(kohnz, literal_bits, huffman->length);
+      continue;
+    }
+
+    const int length = (token >> 16) & 0x1ff;
+    const int distance = (token & 0xffff) + 1;
+    int code = deflate_length_table[length].code;
+    int extra_bits = deflate_length_table[length].extra_bits;
+
+    huffman = &table->literals[code];
+    write_bits(kohnz, huffman->code, huffman->length);
+
+    STATS_ADD(kohnz, matches, 1);
+    STATS_ADD(kohnz, match_lengths[code - 257], 1);
+    STATS_ADD(kohnz, match_bits, huffman->length + extra_bits);
+
+    if (extra_bits != 0)
+    {
+      write_bits(kohnz, length - deflate_length_codes[code - 257], extra_bits);
+    }
+
+    code = deflate_distance_lookup(distance);
+    extra_bits = deflate_distance_extra_bits[code];
+
+    huffman = &table->distances[code];
+    write_bits(kohnz, huffman->code, huffman->length);
+
+    STATS_ADD(kohnz, match_distances[code], 1);
+    STATS_ADD(kohnz, match_bits, huffman->length + extra_bits);
+
+    if (extra_bits != 0)
+    {
+      write_bits(kohnz, distance - deflate_distance_codes[code], extra_bits);
+    }
+  }
+}
+
+static void write_block(
+  struct _kohnz *kohnz,
+  int count,
+  uint32_t *literals,
+  uint32_t *distances,
+  int is_final)
+{
+  struct _auto_block *auto_block = kohnz->auto_block;
+  struct _kohnz_table *table = &auto_block->table;
+  const struct _kohnz_table *use;
+  uint64_t dynamic_bits, fixed_bits;
+#ifdef KOHNZ_STATS
+  const uint64_t start_cycles = STATS_CYCLES();
+#endif
+
+  // Every block ends with literal 256.
+  literals[256] = 1;
+
+  dynamic_huffman_lengths(literals, table->literals, 286, kohnz->max_code_length);
+  dynamic_huffman_lengths(distances, table->distances, 30, kohnz->max_code_length);
+  dynamic_huffman_codes(table->literals, 286);
+  dynamic_huffman_codes(table->distances, 30);
+  dynamic_huffman_header(table);
+
+  // Extra bits are the same either way so they're left out.
+  dynamic_bits =
+    table->header_length * 8 + table->header_tail.length +
+    table_cost(table, literals, distances);
+
+  fixed_bits = table_cost(&auto_block->fixed, literals, distances);
+
+  write_bits(kohnz, is_final == 0 ? 0 : 1, 1);
+
+  if (dynamic_bits < fixed_bits)
+  {
+    use = table;
+    write_bits(kohnz, 2, 2);
+    STATS_ADD(kohnz, blocks[2], 1);
+    dynamic_huffman_write_header(kohnz, table);
+
+    if (kohnz->max_code_length < DYNAMIC_MAX_BITS)
+    {
+      kohnz->code_length_cost +=
+        dynamic_huffman_limit_cost(literals, table->literals, 286) +
+        dynamic_huffman_limit_cost(distances, table->distances, 30);
+    }
+  }
+    else
+  {
+    use = &auto_block->fixed;
+    write_bits(kohnz, 1, 2);
+    STATS_ADD(kohnz, blocks[1], 1);
+  }
+
+  write_tokens(kohnz, use, auto_block->tokens, count);
+
+  STATS_ADD(kohnz, encode_cycles, STATS_CYCLES() - start_cycles);
+
+  write_bits(kohnz, use->literals[256].code, use->literals[256].length);
+
+  if (is_final != 0) { write_bits_end_block(kohnz); }
+}
+
+static void merge_chunk(struct _auto_block *auto_block)
+{
+  int n;
+
+  for (n = 0; n < 286; n++)
+  {
+    auto_block->block_literals[n] += auto_block->chunk_literals[n];
+  }
+
+  for (n = 0; n < 30; n++)
+  {
+    auto_block->block_distances[n] += auto_block->chunk_distances[n];
+  }
+
+  memset(auto_block->chunk_literals, 0, sizeof(auto_block->chunk_literals));
+  memset(auto_block->chunk_distances, 0, sizeof(auto_block->chunk_distances));
+
+  auto_block->chunk_start = auto_block->count;
+}
+
+static void check_chunk(struct _kohnz *kohnz)
+{
+  struct _auto_block *auto_block = kohnz->auto_block;
+  uint64_t merged, separate;
+
+  if (auto_block->chunk_start != 0)
+  {
+    // Compare coding the chunk along with the rest of the block against
+    // giving it a block (and a header) of its own.
+    merged =
+      entropy_cost(auto_block->block_literals, auto_block->chunk_literals, 286) +
+      entropy_cost(auto_block->block_distances, auto_block->chunk_distances, 30);
+
+    separate =
+      entropy_cost(auto_block->block_literals, NULL, 286) +
+      entropy_cost(auto_block->block_distances, NULL, 30) +
+      entropy_cost(auto_block->chunk_literals, NULL, 286) +
+      entropy_cost(auto_block->chunk_distances, NULL, 30) +
+      header_estimate(auto_block->chunk_literals, auto_block->chunk_distances);
+
+    if (separate < merged)
+    {
+      const int chunk_length = auto_block->count - auto_block->chunk_start;
+
+      write_block(
+        kohnz,
+        auto_block->chunk_start,
+        auto_block->block_literals,
+        auto_block->block_distances,
+        0);
+
+      memmove(
+        auto_block->tokens,
+        auto_block->tokens + auto_block->chunk_start,
+        chunk_length * sizeof(uint32_t));
+
+      memset(auto_block->block_literals, 0, sizeof(auto_block->block_literals));
+      memset(auto_block->block_distances, 0, sizeof(auto_block->block_distances));
+
+      auto_block->count = chunk_length;
+    }
+  }
+
+  merge_chunk(auto_block);
+
+  if (auto_block->count == AUTO_BLOCK_MAX_TOKENS)
+  {
+    auto_block_emit(kohnz, 0);
+  }
+}
+
+struct _auto_block *auto_block_create(const struct _kohnz_allocator *allocator)
+{
+  struct _auto_block *auto_block;
+
+  auto_block = (struct _auto_block *)kohnz_alloc(allocator, sizeof(struct _auto_block));
+
+  if (auto_block == NULL) { return NULL; }
+
+  // The fixed codes as a table so both block types can be written the
+  // same way.
+  dynamic_huffman_fixed(&auto_block->fixed);
+
+  auto_block_reset(auto_block);
+
+  return auto_block;
+}
+
+void auto_block_reset(struct _auto_block *auto_block)
+{
+  auto_block->count = 0;
+  auto_block->chunk_start = 0;
+
+  memset(auto_block->block_literals, 0, sizeof(auto_block->block_literals));
+  memset(auto_block->block_distances, 0, sizeof(auto_block->block_distances));
+  memset(auto_block->chunk_literals, 0, sizeof(auto_block->chunk_literals));
+  memset(auto_block->chunk_distances, 0, sizeof(auto_block->chunk_distances));
+}
+
+int auto_block_literals(struct _kohnz *kohnz, const uint8_t *data, int length)
+{
+  struct _auto_block *auto_block = kohnz->auto_block;
+  int n;
+
+  for (n = 0; n < length; n++)
+  {
+    auto_block->tokens[auto_block->count++] = data[n];
+    auto_block->chunk_literals[data[n]]++;
+
+    if (auto_block->count - auto_block->chunk_start == AUTO_BLOCK_CHUNK)
+    {
+      check_chunk(kohnz);
+    }
+  }
+
+  return 0;
+}
+
+int auto_block_match(struct _kohnz *kohnz, int distance, int length)
+{
+  struct _auto_block *auto_block = kohnz->auto_block;
+
+  if (length < 3 || length > 258) { return -3; }
+  if (distance < 1 || distance > 32768) { return -3; }
+
+  auto_block->tokens[auto_block->count++] =
+    TOKEN_MATCH | (length << 16) | (distance - 1);
+
+  auto_block->chunk_literals[deflate_length_table[length].code]++;
+  auto_block->chunk_distances[deflate_distance_lookup(distance)]++;
+
+  if (auto_block->count - auto_block->chunk_start == AUTO_BLOCK_CHUNK)
+  {
+    check_chunk(kohnz);
+  }
+
+  return 0;
+}
+
+int auto_block_emit(struct _kohnz *kohnz, int is_final)
+{
+  struct _auto_block *auto_block = kohnz->auto_block;
+
+  // A non-final block with nothing in it would only waste bits.
+  if (auto_block->count == 0 && is_final == 0) { return 0; }
+
+  merge_chunk(auto_block);
+
+  write_block(
+    kohnz,
+    auto_block->count,
+    auto_block->block_literals,
+    auto_block->block_distances,
+    is_final);
+
+  auto_block_reset(auto_block);
+
+  return 0;
+}
+
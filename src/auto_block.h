@@ -0,0 +1,46 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ */
+
+#ifndef _AUTO_BLOCK_H
+#define _AUTO_BLOCK_H
+
+#include <stdint.h>
+
+#include "kohnz.h"
+
+// Symbols are held back until a block is written so the block type and
+// its huffman table can be picked from what's actually in it.  Every
+// AUTO_BLOCK_CHUNK symbols the newest chunk is checked against the rest
+// of the block to see if it should start a new one.
+#define AUTO_BLOCK_CHUNK 4096
+#define AUTO_BLOCK_MAX_TOKENS (AUTO_BLOCK_CHUNK * 8)
+
+struct _auto_block
+{
+  int count;
+  int chunk_start;
+  uint32_t block_literals[286];
+  uint32_t block_distances[30];
+  uint32_t chunk_literals[286];
+  uint32_t chunk_distances[30];
+  struct _kohnz_table table;
+  struct _kohnz_table fixed;
+  uint32_t tokens[AUTO_BLOCK_MAX_TOKENS];
+};
+
+struct _auto_block *auto_block_create(const struct _kohnz_allocator *allocator);
+void auto_block_reset(struct _auto_block *auto_block);
+int auto_block_literals(struct _kohnz *kohnz, const uint8_t *data, int length);
+int auto_block_match(struct _kohnz *kohnz, int distance, int length);
+int auto_block_emit(struct _kohnz *kohnz, int is_final);
+
+#endif
+
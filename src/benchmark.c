@@ -0,0 +1,395 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "crc32.h"
+#include "fileio.h"
+#include "kohnz.h"
+#include "kohnz_inline.h"
+
+// Microbenchmarks for the encoder's inner loops.  Each benchmark is run
+// until it has taken at least the minimum time and one CSV line is
+// printed for it, so the output of two versions can be diffed or
+// loaded into a spreadsheet.
+//
+// Usage: benchmark [min_ms] [filter]
+
+#define DATA_SIZE 65536
+#define MATCH_COUNT 4096
+#define BITS_COUNT 65536
+#define CLOSE_SIZE 4096
+
+struct _bench
+{
+  struct _kohnz *kohnz;
+  struct _kohnz_snapshot snapshot;
+  uint8_t data[DATA_SIZE];
+  uint16_t distances[MATCH_COUNT];
+  uint16_t lengths[MATCH_COUNT];
+  uint8_t bits[BITS_COUNT];
+};
+
+struct _benchmark
+{
+  const char *name;
+  int (*setup)(struct _bench *bench, int arg);
+  int (*run)(struct _bench *bench);
+  int arg;
+};
+
+enum
+{
+  DATA_ZEROS,
+  DATA_TEXT,
+  DATA_RANDOM,
+  DATA_HIGH,
+};
+
+enum
+{
+  MIX_SHORT_NEAR,
+  MIX_LONG_NEAR,
+  MIX_SHORT_FAR,
+  MIX_MIXED,
+};
+
+static uint32_t seed = 1;
+
+static uint32_t next_random()
+{
+  // xorshift32, so every run benchmarks the same data.
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+
+  return seed;
+}
+
+static int random_range(int low, int high)
+{
+  return low + (next_random() % (high - low + 1));
+}
+
+static uint64_t get_time_ns()
+{
+  struct timespec tp;
+
+  clock_gettime(CLOCK_MONOTONIC, &tp);
+
+  return (uint64_t)tp.tv_sec * 1000000000 + tp.tv_nsec;
+}
+
+static void fill_data(uint8_t *data, int type)
+{
+  const char *words[] =
+  {
+    "the ", "kohnz ", "block ", "of ", "data ", "and ", "huffman ",
+    "a ", "is ", "written ", "to ", "stream ", "\n", "1234 ", ", "
+  };
+  int n;
+
+  switch (type)
+  {
+    case DATA_ZEROS:
+      memset(data, 0, DATA_SIZE);
+      break;
+    case DATA_TEXT:
+      n = 0;
+
+      while (n < DATA_SIZE)
+      {
+        const char *word = words[next_random() % 15];
+
+        while (*word != 0 && n < DATA_SIZE) { data[n++] = *word++; }
+      }
+      break;
+    case DATA_RANDOM:
+      for (n = 0; n < DATA_SIZE; n++) { data[n] = next_random(); }
+      break;
+    case DATA_HIGH:
+      // Every byte from 144 to 255 has a 9 bit fixed code.
+      for (n = 0; n < DATA_SIZE; n++) { data[n] = random_range(144, 255); }
+      break;
+  }
+}
+
+static int open_memory(struct _bench *bench)
+{
+  bench->kohnz = kohnz_open_memory();
+
+  if (bench->kohnz == NULL) { return -1; }
+
+  kohnz_start_fixed_block(bench->kohnz, 0);
+
+  return 0;
+}
+
+static int setup_crc32(struct _bench *bench, int arg)
+{
+  fill_data(bench->data, DATA_RANDOM);
+
+  return 0;
+}
+
+static int run_crc32(struct _bench *bench)
+{
+  volatile uint32_t crc;
+
+  crc = kohnz_crc32(bench->data, DATA_SIZE, 0xffffffff);
+  (void)crc;
+
+  return DATA_SIZE;
+}
+
+static int setup_write_fixed(struct _bench *bench, int arg)
+{
+  fill_data(bench->data, arg);
+
+  if (open_memory(bench) != 0) { return -1; }
+
+  // Rolling back to here after each run keeps the output buffer from
+  // growing without end.
+  return kohnz_snapshot_take(bench->kohnz, &bench->snapshot);
+}
+
+static int run_write_fixed(struct _bench *bench)
+{
+  kohnz_write_fixed(bench->kohnz, bench->data, DATA_SIZE);
+  kohnz_snapshot_restore(bench->kohnz, &bench->snapshot);
+
+  return DATA_SIZE;
+}
+
+static int run_write_fixed_inline(struct _bench *bench)
+{
+  kohnz_write_fixed_inline(bench->kohnz, bench->data, DATA_SIZE);
+  kohnz_snapshot_restore(bench->kohnz, &bench->snapshot);
+
+  return DATA_SIZE;
+}
+
+static int setup_write_lz77(struct _bench *bench, int arg)
+{
+  int n;
+
+  for (n = 0; n < MATCH_COUNT; n++)
+  {
+    int mix = arg == MIX_MIXED ? next_random() % 3 : arg;
+
+    switch (mix)
+    {
+      case MIX_SHORT_NEAR:
+        bench->lengths[n] = random_range(3, 10);
+        bench->distances[n] = random_range(1, 64);
+        break;
+      case MIX_LONG_NEAR:
+        bench->lengths[n] = random_range(100, 258);
+        bench->distances[n] = random_range(1, 4096);
+        break;
+      case MIX_SHORT_FAR:
+        bench->lengths[n] = random_range(3, 10);
+        bench->distances[n] = random_range(8192, 32768);
+        break;
+    }
+  }
+
+  // Distances are checked against how much data has been written, so
+  // a full window of literals goes out before the snapshot.
+  fill_data(bench->data, DATA_TEXT);
+
+  if (open_memory(bench) != 0) { return -1; }
+
+  kohnz_write_fixed(bench->kohnz, bench->data, 32768);
+
+  return kohnz_snapshot_take(bench->kohnz, &bench->snapshot);
+}
+
+static int run_write_lz77(struct _bench *bench)
+{
+  int bytes = 0;
+  int n;
+
+  for (n = 0; n < MATCH_COUNT; n++)
+  {
+    kohnz_write_fixed_lz77(bench->kohnz, bench->distances[n], bench->lengths[n]);
+    bytes += bench->lengths[n];
+  }
+
+  kohnz_snapshot_restore(bench->kohnz, &bench->snapshot);
+
+  return bytes;
+}
+
+static int run_write_lz77_inline(struct _bench *bench)
+{
+  int bytes = 0;
+  int n;
+
+  for (n = 0; n < MATCH_COUNT; n++)
+  {
+    kohnz_write_fixed_lz77_inline(
+      bench->kohnz,
+      bench->distances[n],
+      bench->lengths[n]);
+
+    bytes += bench->lengths[n];
+  }
+
+  kohnz_snapshot_restore(bench->kohnz, &bench->snapshot);
+
+  return bytes;
+}
+
+static int setup_write_bits(struct _bench *bench, int arg)
+{
+  int n;
+
+  for (n = 0; n < BITS_COUNT; n++) { bench->bits[n] = random_range(1, 15); }
+
+  if (open_memory(bench) != 0) { return -1; }
+
+  return kohnz_snapshot_take(bench->kohnz, &bench->snapshot);
+}
+
+static int run_write_bits(struct _bench *bench)
+{
+  int bits = 0;
+  int n;
+
+  for (n = 0; n < BITS_COUNT; n++)
+  {
+    write_bits(bench->kohnz, n & ((1 << bench->bits[n]) - 1), bench->bits[n]);
+    bits += bench->bits[n];
+  }
+
+  kohnz_snapshot_restore(bench->kohnz, &bench->snapshot);
+
+  return bits / 8;
+}
+
+static int setup_close(struct _bench *bench, int arg)
+{
+  fill_data(bench->data, DATA_TEXT);
+
+  return 0;
+}
+
+static int run_close(struct _bench *bench)
+{
+  struct _kohnz *kohnz;
+
+  // A whole file: header, one final block, trailer, and the write to
+  // the file on close.
+  kohnz = kohnz_open("/dev/null", NULL, NULL);
+
+  if (kohnz == NULL) { return -1; }
+
+  kohnz_start_fixed_block(kohnz, 1);
+  kohnz_write_fixed(kohnz, bench->data, CLOSE_SIZE);
+  kohnz_end_fixed_block(kohnz);
+  kohnz_close(kohnz);
+
+  return CLOSE_SIZE;
+}
+
+static struct _benchmark benchmarks[] =
+{
+  { "crc32", setup_crc32, run_crc32, 0 },
+  { "write_fixed_zeros", setup_write_fixed, run_write_fixed, DATA_ZEROS },
+  { "write_fixed_text", setup_write_fixed, run_write_fixed, DATA_TEXT },
+  { "write_fixed_random", setup_write_fixed, run_write_fixed, DATA_RANDOM },
+  { "write_fixed_high", setup_write_fixed, run_write_fixed, DATA_HIGH },
+  { "write_lz77_short_near", setup_write_lz77, run_write_lz77, MIX_SHORT_NEAR },
+  { "write_lz77_long_near", setup_write_lz77, run_write_lz77, MIX_LONG_NEAR },
+  { "write_lz77_short_far", setup_write_lz77, run_write_lz77, MIX_SHORT_FAR },
+  { "write_lz77_mixed", setup_write_lz77, run_write_lz77, MIX_MIXED },
+  { "write_fixed_inline_text", setup_write_fixed, run_write_fixed_inline, DATA_TEXT },
+  { "write_fixed_inline_high", setup_write_fixed, run_write_fixed_inline, DATA_HIGH },
+  { "write_lz77_inline_mixed", setup_write_lz77, run_write_lz77_inline, MIX_MIXED },
+  { "write_bits", setup_write_bits, run_write_bits, 0 },
+  { "close_4k", setup_close, run_close, 0 },
+  { NULL, NULL, NULL, 0 }
+};
+
+int main(int argc, char *argv[])
+{
+  struct _bench *bench;
+  uint64_t min_ns = 500000000;
+  const char *filter = NULL;
+  int n;
+
+  if (argc >= 2) { min_ns = (uint64_t)atoi(argv[1]) * 1000000; }
+  if (argc >= 3) { filter = argv[2]; }
+
+  bench = (struct _bench *)malloc(sizeof(struct _bench));
+
+  if (bench == NULL) { return -1; }
+
+  printf("benchmark,bytes_per_op,ops,ns_per_op,mb_per_s\n");
+
+  for (n = 0; benchmarks[n].name != NULL; n++)
+  {
+    const struct _benchmark *benchmark = &benchmarks[n];
+    uint64_t start, elapsed, ops, bytes;
+    int size;
+
+    if (filter != NULL && strstr(benchmark->name, filter) == NULL)
+    {
+      continue;
+    }
+
+    memset(bench, 0, sizeof(struct _bench));
+    seed = 1;
+
+    if (benchmark->setup(bench, benchmark->arg) != 0)
+    {
+      fprintf(stderr, "Error: setup failed for %s\n", benchmark->name);
+      return -1;
+    }
+
+    // One run first so the caches and branch predictors are warm.
+    size = benchmark->run(bench);
+
+    ops = 0;
+    bytes = 0;
+    start = get_time_ns();
+
+    do
+    {
+      bytes += benchmark->run(bench);
+      ops++;
+      elapsed = get_time_ns() - start;
+    } while (elapsed < min_ns);
+
+    printf("%s,%d,%lu,%.1f,%.1f\n",
+      benchmark->name,
+      size,
+      (unsigned long)ops,
+      (double)elapsed / ops,
+      ((double)bytes / (1024 * 1024)) / ((double)elapsed / 1000000000));
+
+    if (bench->kohnz != NULL)
+    {
+      kohnz_snapshot_release(bench->kohnz, &bench->snapshot);
+      kohnz_close(bench->kohnz);
+    }
+  }
+
+  free(bench);
+
+  return 0;
+}
+
@@ -0,0 +1,221 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "bgzf.h"
+#include "crc32.h"
+#include "fileio.h"
+#include "kohnz.h"
+
+// An empty member, which BGZF readers use to tell the file wasn't cut off.
+static const uint8_t bgzf_eof[28] =
+{
+  0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0xff, 0x06, 0x00, 0x42, 0x43, 0x02, 0x00,
+  0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00
+};
+
+static void write_index64(FILE *out, uint64_t num)
+{
+  uint8_t data[8];
+  int n;
+
+  for (n = 0; n < 8; n++)
+  {
+    data[n] = num >> (n * 8);
+  }
+
+  fwrite(data, sizeof(data), 1, out);
+}
+
+static void write_member_header(struct _kohnz *kohnz, int member_size)
+{
+  // Magic number
+  write8(kohnz, 0x1f);
+  write8(kohnz, 0x8b);
+  // Compression method 8 (DEFLATE)
+  write8(kohnz, 0x08);
+  // Flags: FEXTRA
+  write8(kohnz, 0x04);
+  // Timestamp
+  write32(kohnz, 0);
+  // Compression flags
+  write8(kohnz, 0x00);
+  // Operating system (unknown)
+  write8(kohnz, 0xff);
+  // XLEN then the BC subfield, which holds the member size minus 1.
+  write16(kohnz, 6);
+  write8(kohnz, 'B');
+  write8(kohnz, 'C');
+  write16(kohnz, 2);
+  write16(kohnz, member_size - 1);
+}
+
+static int write_member(struct _kohnz *kohnz)
+{
+  struct _bgzf *bgzf = kohnz->bgzf;
+  struct _kohnz *member = bgzf->member;
+  const int length = bgzf->input_length;
+  int member_size;
+
+  // Each member is compressed on its own so it can be decompressed
+  // without anything that came before it.
+  kohnz_reset(member);
+
+  // The level is set on the BGZF context, and the match finder picks
+  // its chain and nice lengths from it.
+  member->level = kohnz->level;
+
+  kohnz_start_fixed_block(member, 1);
+  kohnz_compress(member, bgzf->input, length);
+  kohnz_end_fixed_block(member);
+
+  member_size = BGZF_HEADER_SIZE + member->buffer_length + BGZF_TRAILER_SIZE;
+
+  if (member_size > BGZF_MAX_MEMBER)
+  {
+    // Didn't compress, so store it instead.
+    kohnz_reset(member);
+    kohnz_start_uncompressed_block(member);
+    kohnz_write_uncompressed(member, bgzf->input, length);
+
+    member_size = BGZF_HEADER_SIZE + member->buffer_length + BGZF_TRAILER_SIZE;
+  }
+
+  if (bgzf->index != NULL && bgzf->compressed_offset != 0)
+  {
+    write_index64(bgzf->index, bgzf->compressed_offset);
+    write_index64(bgzf->index, bgzf->uncompressed_offset);
+    bgzf->index_count++;
+  }
+
+  write_member_header(kohnz, member_size);
+
+  if (write_data(kohnz, member->buffer, member->buffer_length) != 0)
+  {
+    return -1;
+  }
+
+  write32(kohnz, member->crc32 ^ 0xffffffff);
+  write32(kohnz, length);
+
+  bgzf->compressed_offset += member_size;
+  bgzf->uncompressed_offset += length;
+  bgzf->input_length = 0;
+
+  kohnz->crc32 = kohnz_crc32_combine(
+    kohnz->crc32 ^ 0xffffffff,
+    member->crc32 ^ 0xffffffff,
+    length) ^ 0xffffffff;
+  kohnz->file_size += length;
+
+  return 0;
+}
+
+int bgzf_open(struct _kohnz *kohnz, const char *index_filename)
+{
+  struct _bgzf *bgzf;
+
+  bgzf = (struct _bgzf *)kohnz_alloc(&kohnz->allocator, sizeof(struct _bgzf));
+
+  if (bgzf == NULL) { return -1; }
+
+  memset(bgzf, 0, sizeof(struct _bgzf) - BGZF_BLOCK_SIZE);
+
+  bgzf->member = kohnz_open_memory_with(&kohnz->allocator);
+
+  if (bgzf->member == NULL)
+  {
+    kohnz_free(&kohnz->allocator, bgzf);
+    return -1;
+  }
+
+  if (index_filename != NULL)
+  {
+    bgzf->index = fopen(index_filename, "wb");
+
+    if (bgzf->index == NULL)
+    {
+      kohnz_close(bgzf->member);
+      kohnz_free(&kohnz->allocator, bgzf);
+      return -1;
+    }
+
+    // The entry count gets filled in on close.
+    write_index64(bgzf->index, 0);
+  }
+
+  kohnz->bgzf = bgzf;
+
+  return 0;
+}
+
+int bgzf_write(struct _kohnz *kohnz, const uint8_t *data, int length)
+{
+  struct _bgzf *bgzf = kohnz->bgzf;
+  int count;
+
+  while (length > 0)
+  {
+    count = BGZF_BLOCK_SIZE - bgzf->input_length;
+
+    if (count > length) { count = length; }
+
+    memcpy(bgzf->input + bgzf->input_length, data, count);
+    bgzf->input_length += count;
+
+    data += count;
+    length -= count;
+
+    if (bgzf->input_length == BGZF_BLOCK_SIZE)
+    {
+      if (write_member(kohnz) != 0) { return -1; }
+    }
+  }
+
+  return 0;
+}
+
+int bgzf_close(struct _kohnz *kohnz)
+{
+  struct _bgzf *bgzf = kohnz->bgzf;
+  int ret = 0;
+
+  if (bgzf->input_length != 0)
+  {
+    if (write_member(kohnz) != 0) { ret = -1; }
+  }
+
+  if (write_data(kohnz, bgzf_eof, sizeof(bgzf_eof)) != 0) { ret = -1; }
+
+  // The index is the .gzi layout: a count followed by compressed and
+  // uncompressed offsets for the start of every member except the first.
+  if (bgzf->index != NULL)
+  {
+    fseek(bgzf->index, 0, SEEK_SET);
+    write_index64(bgzf->index, bgzf->index_count);
+
+    if (fclose(bgzf->index) != 0) { ret = -1; }
+  }
+
+  kohnz_close(bgzf->member);
+  kohnz_free(&kohnz->allocator, bgzf);
+
+  kohnz->bgzf = NULL;
+
+  return ret;
+}
+
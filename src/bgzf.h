@@ -0,0 +1,43 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ */
+
+#ifndef _BGZF_H
+#define _BGZF_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "kohnz.h"
+
+// Same input size per member as samtools / htslib use, which leaves
+// room for a stored block if the data doesn't compress.
+#define BGZF_BLOCK_SIZE 0xff00
+#define BGZF_MAX_MEMBER 65536
+#define BGZF_HEADER_SIZE 18
+#define BGZF_TRAILER_SIZE 8
+
+struct _bgzf
+{
+  struct _kohnz *member;
+  FILE *index;
+  uint64_t index_count;
+  uint64_t compressed_offset;
+  uint64_t uncompressed_offset;
+  int input_length;
+  uint8_t input[BGZF_BLOCK_SIZE];
+};
+
+int bgzf_open(struct _kohnz *kohnz, const char *index_filename);
+int bgzf_write(struct _kohnz *kohnz, const uint8_t *data, int length);
+int bgzf_close(struct _kohnz *kohnz);
+
+#endif
+
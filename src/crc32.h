@@ -14,8 +14,8 @@
 
 #include <stdint.h>
 
-int kohnz_crc32_init();
 uint32_t kohnz_crc32(const uint8_t *buffer, int len, uint32_t crc);
+uint32_t kohnz_crc32_combine(uint32_t crc1, uint32_t crc2, uint64_t length2);
 
 #endif
 
@@ -15,7 +15,7 @@
 
 #include "deflate_codes.h"
 
-int deflate_length_codes[29] =
+const int deflate_length_codes[29] =
 {
     3,   4,   5,   6,   7,  8,  9,  10,
    11,  13,  15,  17,  19, 23, 27,  31,
@@ -23,7 +23,7 @@ int deflate_length_codes[29] =
   131, 163, 195, 227, 258
 };
 
-int deflate_length_extra_bits[29] =
+const int deflate_length_extra_bits[29] =
 {
   0, 0, 0, 0, 0, 0, 0, 0,
   1, 1, 1, 1, 2, 2, 2, 2,
@@ -31,7 +31,7 @@ int deflate_length_extra_bits[29] =
   5, 5, 5, 5, 0
 };
 
-int deflate_distance_codes[30] =
+const int deflate_distance_codes[30] =
 {
      1,    2,    3,     4,     5,     7,    9,   13,
     17,   25,   33,    49,    65,    97,  129,  193,
@@ -39,7 +39,7 @@ int deflate_distance_codes[30] =
   4097, 6145, 8193, 12289, 16385, 24577
 };
 
-int deflate_distance_extra_bits[30] =
+const int deflate_distance_extra_bits[30] =
 {
    0,  0,  0,  0,  1,  1,  2,  2,
    3,  3,  4,  4,  5,  5,  6,  6,
@@ -47,14 +47,14 @@ int deflate_distance_extra_bits[30] =
   11, 11, 12, 12, 13, 13
 };
 
-uint8_t deflate_hclen_map[19] =
+const uint8_t deflate_hclen_map[19] =
 {
   16, 17, 18, 0,  8, 7,  9, 6,
   10,  5, 11, 4, 12, 3, 13, 2,
   14,  1, 15
 };
 
-int deflate_reverse[256] =
+const int deflate_reverse[256] =
 {
   0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0,
   0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0,
@@ -90,49 +90,89 @@ int deflate_reverse[256] =
   0x1f, 0x9f, 0x5f, 0xdf, 0x3f, 0xbf, 0x7f, 0xff,
 };
 
-struct _deflate_table deflate_length_table[286];
-struct _deflate_table deflate_distance_table[32768];
-
-void deflate_length_table_init()
+// Maps a match length (3 to 258) to its length code and extra bits.
+const struct _deflate_table deflate_length_table[259] =
 {
-  int n, i, code, length, count;
-
-  memset(deflate_length_table, 0, sizeof(deflate_length_table));
-
-  for (n = 0; n < 29; n++)
-  {
-    code = n + 257;
-    length = deflate_length_codes[n];
-
-    count = (1 << deflate_length_extra_bits[n]);
-
-    for (i = 0; i < count; i++)
-    {
-      deflate_length_table[length].code = code;
-      deflate_length_table[length].extra_bits = deflate_length_extra_bits[n];
-      length++;
-    }
-  }
-}
+  { 0, 0 }, { 0, 0 }, { 0, 0 }, { 257, 0 }, { 258, 0 }, { 259, 0 },
+  { 260, 0 }, { 261, 0 }, { 262, 0 }, { 263, 0 }, { 264, 0 }, { 265, 1 },
+  { 265, 1 }, { 266, 1 }, { 266, 1 }, { 267, 1 }, { 267, 1 }, { 268, 1 },
+  { 268, 1 }, { 269, 2 }, { 269, 2 }, { 269, 2 }, { 269, 2 }, { 270, 2 },
+  { 270, 2 }, { 270, 2 }, { 270, 2 }, { 271, 2 }, { 271, 2 }, { 271, 2 },
+  { 271, 2 }, { 272, 2 }, { 272, 2 }, { 272, 2 }, { 272, 2 }, { 273, 3 },
+  { 273, 3 }, { 273, 3 }, { 273, 3 }, { 273, 3 }, { 273, 3 }, { 273, 3 },
+  { 273, 3 }, { 274, 3 }, { 274, 3 }, { 274, 3 }, { 274, 3 }, { 274, 3 },
+  { 274, 3 }, { 274, 3 }, { 274, 3 }, { 275, 3 }, { 275, 3 }, { 275, 3 },
+  { 275, 3 }, { 275, 3 }, { 275, 3 }, { 275, 3 }, { 275, 3 }, { 276, 3 },
+  { 276, 3 }, { 276, 3 }, { 276, 3 }, { 276, 3 }, { 276, 3 }, { 276, 3 },
+  { 276, 3 }, { 277, 4 }, { 277, 4 }, { 277, 4 }, { 277, 4 }, { 277, 4 },
+  { 277, 4 }, { 277, 4 }, { 277, 4 }, { 277, 4 }, { 277, 4 }, { 277, 4 },
+  { 277, 4 }, { 277, 4 }, { 277, 4 }, { 277, 4 }, { 277, 4 }, { 278, 4 },
+  { 278, 4 }, { 278, 4 }, { 278, 4 }, { 278, 4 }, { 278, 4 }, { 278, 4 },
+  { 278, 4 }, { 278, 4 }, { 278, 4 }, { 278, 4 }, { 278, 4 }, { 278, 4 },
+  { 278, 4 }, { 278, 4 }, { 278, 4 }, { 279, 4 }, { 279, 4 }, { 279, 4 },
+  { 279, 4 }, { 279, 4 }, { 279, 4 }, { 279, 4 }, { 279, 4 }, { 279, 4 },
+  { 279, 4 }, { 279, 4 }, { 279, 4 }, { 279, 4 }, { 279, 4 }, { 279, 4 },
+  { 279, 4 }, { 280, 4 }, { 280, 4 }, { 280, 4 }, { 280, 4 }, { 280, 4 },
+  { 280, 4 }, { 280, 4 }, { 280, 4 }, { 280, 4 }, { 280, 4 }, { 280, 4 },
+  { 280, 4 }, { 280, 4 }, { 280, 4 }, { 280, 4 }, { 280, 4 }, { 281, 5 },
+  { 281, 5 }, { 281, 5 }, { 281, 5 }, { 281, 5 }, { 281, 5 }, { 281, 5 },
+  { 281, 5 }, { 281, 5 }, { 281, 5 }, { 281, 5 }, { 281, 5 }, { 281, 5 },
+  { 281, 5 }, { 281, 5 }, { 281, 5 }, { 281, 5 }, { 281, 5 }, { 281, 5 },
+  { 281, 5 }, { 281, 5 }, { 281, 5 }, { 281, 5 }, { 281, 5 }, { 281, 5 },
+  { 281, 5 }, { 281, 5 }, { 281, 5 }, { 281, 5 }, { 281, 5 }, { 281, 5 },
+  { 281, 5 }, { 282, 5 }, { 282, 5 }, { 282, 5 }, { 282, 5 }, { 282, 5 },
+  { 282, 5 }, { 282, 5 }, { 282, 5 }, { 282, 5 }, { 282, 5 }, { 282, 5 },
+  { 282, 5 }, { 282, 5 }, { 282, 5 }, { 282, 5 }, { 282, 5 }, { 282, 5 },
+  { 282, 5 }, { 282, 5 }, { 282, 5 }, { 282, 5 }, { 282, 5 }, { 282, 5 },
+  { 282, 5 }, { 282, 5 }, { 282, 5 }, { 282, 5 }, { 282, 5 }, { 282, 5 },
+  { 282, 5 }, { 282, 5 }, { 282, 5 }, { 283, 5 }, { 283, 5 }, { 283, 5 },
+  { 283, 5 }, { 283, 5 }, { 283, 5 }, { 283, 5 }, { 283, 5 }, { 283, 5 },
+  { 283, 5 }, { 283, 5 }, { 283, 5 }, { 283, 5 }, { 283, 5 }, { 283, 5 },
+  { 283, 5 }, { 283, 5 }, { 283, 5 }, { 283, 5 }, { 283, 5 }, { 283, 5 },
+  { 283, 5 }, { 283, 5 }, { 283, 5 }, { 283, 5 }, { 283, 5 }, { 283, 5 },
+  { 283, 5 }, { 283, 5 }, { 283, 5 }, { 283, 5 }, { 283, 5 }, { 284, 5 },
+  { 284, 5 }, { 284, 5 }, { 284, 5 }, { 284, 5 }, { 284, 5 }, { 284, 5 },
+  { 284, 5 }, { 284, 5 }, { 284, 5 }, { 284, 5 }, { 284, 5 }, { 284, 5 },
+  { 284, 5 }, { 284, 5 }, { 284, 5 }, { 284, 5 }, { 284, 5 }, { 284, 5 },
+  { 284, 5 }, { 284, 5 }, { 284, 5 }, { 284, 5 }, { 284, 5 }, { 284, 5 },
+  { 284, 5 }, { 284, 5 }, { 284, 5 }, { 284, 5 }, { 284, 5 }, { 284, 5 },
+  { 285, 0 },
+};
 
-void deflate_distance_table_init()
+// Maps a distance to its distance code, see deflate_distance_lookup().
+const uint8_t deflate_distance_code[512] =
 {
-  int i, code, distance, count;
-
-  memset(deflate_distance_table, 0, sizeof(deflate_distance_table));
-
-  for (code = 0; code < 30; code++)
-  {
-    distance = deflate_distance_codes[code];
-
-    count = (1 << deflate_distance_extra_bits[code]);
-
-    for (i = 0; i < count; i++)
-    {
-      deflate_distance_table[distance - 1].code = code;
-      deflate_distance_table[distance - 1].extra_bits = deflate_distance_extra_bits[code];
-      distance++;
-    }
-  }
-}
+   0,  1,  2,  3,  4,  4,  5,  5,  6,  6,  6,  6,  7,  7,  7,  7,
+   8,  8,  8,  8,  8,  8,  8,  8,  9,  9,  9,  9,  9,  9,  9,  9,
+  10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10,
+  11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+  12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+  12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+  13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13,
+  13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13,
+  14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+  14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+  14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+  14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+  15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+  15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+  15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+  15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+   0,  0, 16, 17, 18, 18, 19, 19, 20, 20, 20, 20, 21, 21, 21, 21,
+  22, 22, 22, 22, 22, 22, 22, 22, 23, 23, 23, 23, 23, 23, 23, 23,
+  24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+  25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25,
+  26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
+  26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
+  27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27,
+  27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27,
+  28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+  28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+  28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+  28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+  29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29,
+  29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29,
+  29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29,
+  29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29,
+};
 
@@ -20,17 +20,26 @@ struct _deflate_table
   uint8_t extra_bits;
 };
 
-extern int deflate_length_codes[29];
-extern int deflate_length_extra_bits[29];
-extern int deflate_distance_codes[30];
-extern int deflate_distance_extra_bits[30];
-extern uint8_t deflate_hclen_map[19];
-extern int deflate_reverse[256];
-extern struct _deflate_table deflate_length_table[286];
-extern struct _deflate_table deflate_distance_table[32768];
-
-void deflate_length_table_init();
-void deflate_distance_table_init();
+extern const int deflate_length_codes[29];
+extern const int deflate_length_extra_bits[29];
+extern const int deflate_distance_codes[30];
+extern const int deflate_distance_extra_bits[30];
+extern const uint8_t deflate_hclen_map[19];
+extern const int deflate_reverse[256];
+extern const struct _deflate_table deflate_length_table[259];
+extern const uint8_t deflate_distance_code[512];
+
+// Distances 1 to 256 are looked up directly.  Above that the bottom 7 bits
+// are always extra bits so distance - 1 is shifted down to index the
+// second half of the table.
+static inline int deflate_distance_lookup(int distance)
+{
+  distance--;
+
+  if (distance < 256) { return deflate_distance_code[distance]; }
+
+  return deflate_distance_code[256 + (distance >> 7)];
+}
 
 #endif
 
@@ -13,22 +13,227 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "alloc.h"
 #include "deflate_codes.h"
 #include "dynamic_huffman.h"
 #include "fileio.h"
+#include "matcher.h"
+#include "stats.h"
 
-#if 0
-static uint8_t coding_map[] =
+#define MAX_SYMBOLS 288
+#define TABLE_MAGIC_0 'K'
+#define TABLE_MAGIC_1 'T'
+#define TABLE_VERSION 1
+
+struct _leaf
+{
+  uint32_t count;
+  uint16_t symbol;
+};
+
+struct _header_writer
 {
-  16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+  uint8_t *data;
+  int length;
+  uint32_t holding;
+  int bits;
 };
-#endif
 
-static int build_huffman_values(
+static int compare_leaves(const void *a, const void *b)
+{
+  const struct _leaf *leaf_a = (const struct _leaf *)a;
+  const struct _leaf *leaf_b = (const struct _leaf *)b;
+
+  if (leaf_a->count != leaf_b->count)
+  {
+    return leaf_a->count < leaf_b->count ? -1 : 1;
+  }
+
+  return leaf_a->symbol - leaf_b->symbol;
+}
+
+static inline uint16_t reverse_code(int code, int length)
+{
+  // Huffman codes are packed starting with the most significant bit,
+  // but write_bits() sends the least significant bit first.
+  const int reversed =
+    (deflate_reverse[code & 0xff] << 8) | deflate_reverse[code >> 8];
+
+  return reversed >> (16 - length);
+}
+
+static void header_put(struct _header_writer *writer, uint32_t data, int length)
+{
+  writer->holding |= data << writer->bits;
+  writer->bits += length;
+
+  while (writer->bits >= 8)
+  {
+    writer->data[writer->length++] = writer->holding & 0xff;
+    writer->holding >>= 8;
+    writer->bits -= 8;
+  }
+}
+
+int dynamic_huffman_lengths(
+  const uint32_t *counts,
   struct _huffman *table,
+  int table_length,
+  int max_bits)
+{
+  struct _leaf leaves[MAX_SYMBOLS];
+  uint64_t weight[MAX_SYMBOLS * 2];
+  uint16_t parent[MAX_SYMBOLS * 2];
+  uint16_t depth[MAX_SYMBOLS * 2];
+  int bl_count[MAX_SYMBOLS];
+  int count = 0;
+  int next_leaf, next_node;
+  int n, k, length;
+  uint32_t total;
+
+  if (table_length > MAX_SYMBOLS) { return -1; }
+
+  for (n = 0; n < table_length; n++)
+  {
+    table[n].length = 0;
+    table[n].code = 0;
+
+    if (counts[n] != 0)
+    {
+      leaves[count].count = counts[n];
+      leaves[count].symbol = n;
+      count++;
+    }
+  }
+
+  // A code needs at least two symbols to be complete, so pad it out with
+  // codes that won't be used.
+  if (count < 2)
+  {
+    const int symbol = count == 0 ? 0 : leaves[0].symbol;
+
+    table[symbol].length = 1;
+    table[symbol == 0 ? 1 : 0].length = 1;
+
+    return 0;
+  }
+
+  qsort(leaves, count, sizeof(struct _leaf), compare_leaves);
+
+  // With the leaves sorted the internal nodes are created in order of
+  // weight too, so the two smallest are always at the front of one of
+  // the two lists.
+  for (n = 0; n < count; n++) { weight[n] = leaves[n].count; }
+
+  next_leaf = 0;
+  next_node = count;
+
+  for (k = count; k < count * 2 - 1; k++)
+  {
+    weight[k] = 0;
+
+    for (n = 0; n < 2; n++)
+    {
+      int node;
+
+      if (next_leaf < count &&
+         (next_node >= k || weight[next_leaf] <= weight[next_node]))
+      {
+        node = next_leaf++;
+      }
+        else
+      {
+        node = next_node++;
+      }
+
+      weight[k] += weight[node];
+      parent[node] = k;
+    }
+  }
+
+  // Parents always come after their children so the depths can be
+  // filled in walking backwards from the root.
+  depth[count * 2 - 2] = 0;
+
+  for (k = count * 2 - 3; k >= 0; k--)
+  {
+    depth[k] = depth[parent[k]] + 1;
+  }
+
+  memset(bl_count, 0, sizeof(bl_count));
+
+  for (n = 0; n < count; n++)
+  {
+    length = depth[n] > max_bits ? max_bits : depth[n];
+    bl_count[length]++;
+  }
+
+  // Codes that were cut down to max_bits leave the tree oversubscribed.
+  // Each pass takes away one max_bits code and moves the deepest shorter
+  // code down a level where it now has room for two.
+  total = 0;
+
+  for (n = 1; n <= max_bits; n++)
+  {
+    total += bl_count[n] << (max_bits - n);
+  }
+
+  while (total > (1U << max_bits))
+  {
+    bl_count[max_bits]--;
+
+    for (n = max_bits - 1; n > 0; n--)
+    {
+      if (bl_count[n] != 0)
+      {
+        bl_count[n]--;
+        bl_count[n + 1] += 2;
+        break;
+      }
+    }
+
+    total--;
+  }
+
+  // The least common symbols get the longest codes.
+  k = 0;
+
+  for (length = max_bits; length > 0; length--)
+  {
+    for (n = 0; n < bl_count[length]; n++)
+    {
+      table[leaves[k++].symbol].length = length;
+    }
+  }
+
+  return 0;
+}
+
+uint64_t dynamic_huffman_limit_cost(
+  const uint32_t *counts,
+  const struct _huffman *table,
   int table_length)
 {
-  uint8_t bl_count[16];
+  struct _huffman unlimited[MAX_SYMBOLS];
+  uint64_t limited_bits = 0;
+  uint64_t unlimited_bits = 0;
+  int n;
+
+  // Extra bits the table costs compared to one with 15 bit codes.
+  dynamic_huffman_lengths(counts, unlimited, table_length, DYNAMIC_MAX_BITS);
+
+  for (n = 0; n < table_length; n++)
+  {
+    limited_bits += (uint64_t)counts[n] * table[n].length;
+    unlimited_bits += (uint64_t)counts[n] * unlimited[n].length;
+  }
+
+  return limited_bits - unlimited_bits;
+}
+
+void dynamic_huffman_codes(struct _huffman *table, int table_length)
+{
+  uint16_t bl_count[16];
   uint16_t next_code[16];
   int code, n;
 
@@ -63,13 +268,195 @@ static int build_huffman_values(
     {
       const int length = table[n].length;
 
-      table[n].code = next_code[length]++;
+      table[n].code = reverse_code(next_code[length]++, length);
+    }
+  }
+}
+
+void dynamic_huffman_fixed(struct _kohnz_table *table)
+{
+  struct _huffman literals[288];
+  int n;
+
+  // The fixed huffman codes from RFC1951.  There's no header since the
+  // decompressor already knows them.  Codes 286 and 287 can't be used
+  // but are still part of the code, so the canonical codes have to be
+  // built with all 288 or the 9 bit codes come out wrong.
+  for (n = 0; n < 288; n++)
+  {
+    if (n <= 143) { literals[n].length = 8; }
+    else if (n <= 255) { literals[n].length = 9; }
+    else if (n <= 279) { literals[n].length = 7; }
+    else { literals[n].length = 8; }
+  }
+
+  dynamic_huffman_codes(literals, 288);
+
+  memcpy(table->literals, literals, sizeof(table->literals));
+
+  for (n = 0; n < 30; n++) { table->distances[n].length = 5; }
+
+  dynamic_huffman_codes(table->distances, 30);
+
+  table->literals_length = 286;
+  table->distances_length = 30;
+  table->header_length = 0;
+  table->header_tail.holding = 0;
+  table->header_tail.length = 0;
+}
+
+int dynamic_huffman_header(struct _kohnz_table *table)
+{
+  struct _header_writer writer;
+  struct _huffman coding[19];
+  uint32_t counts[19];
+  uint8_t lengths[286 + 30];
+  uint8_t symbols[286 + 30];
+  uint8_t extra[286 + 30];
+  int symbol_count = 0;
+  int hlit, hdist, hclen;
+  int n, run;
+
+  // Trailing unused codes don't need to be sent.
+  hlit = 286;
+  while (hlit > 257 && table->literals[hlit - 1].length == 0) { hlit--; }
+
+  hdist = 30;
+  while (hdist > 1 && table->distances[hdist - 1].length == 0) { hdist--; }
+
+  table->literals_length = hlit;
+  table->distances_length = hdist;
+
+  for (n = 0; n < hlit; n++) { lengths[n] = table->literals[n].length; }
+
+  for (n = 0; n < hdist; n++)
+  {
+    lengths[hlit + n] = table->distances[n].length;
+  }
+
+  // Run length encode the code lengths as one sequence using 16 (repeat
+  // the last length 3 to 6 times), 17 (3 to 10 zeros) and 18 (11 to 138
+  // zeros).
+  memset(counts, 0, sizeof(counts));
+
+  n = 0;
+
+  while (n < hlit + hdist)
+  {
+    const int length = lengths[n];
+
+    run = 1;
+
+    while (n + run < hlit + hdist && lengths[n + run] == length) { run++; }
+
+    n += run;
+
+    if (length == 0)
+    {
+      while (run >= 11)
+      {
+        const int repeat = run > 138 ? 138 : run;
+
+        symbols[symbol_count] = 18;
+        extra[symbol_count++] = repeat - 11;
+        run -= repeat;
+      }
+
+      if (run >= 3)
+      {
+        symbols[symbol_count] = 17;
+        extra[symbol_count++] = run - 3;
+        run = 0;
+      }
+    }
+      else
+    {
+      symbols[symbol_count] = length;
+      extra[symbol_count++] = 0;
+      run--;
+
+      while (run >= 3)
+      {
+        const int repeat = run > 6 ? 6 : run;
+
+        symbols[symbol_count] = 16;
+        extra[symbol_count++] = repeat - 3;
+        run -= repeat;
+      }
+    }
+
+    while (run > 0)
+    {
+      symbols[symbol_count] = length;
+      extra[symbol_count++] = 0;
+      run--;
     }
   }
 
+  for (n = 0; n < symbol_count; n++) { counts[symbols[n]]++; }
+
+  dynamic_huffman_lengths(counts, coding, 19, DYNAMIC_CODING_MAX_BITS);
+  dynamic_huffman_codes(coding, 19);
+
+  hclen = 19;
+
+  while (hclen > 4 && coding[deflate_hclen_map[hclen - 1]].length == 0)
+  {
+    hclen--;
+  }
+
+  writer.data = table->header;
+  writer.length = 0;
+  writer.holding = 0;
+  writer.bits = 0;
+
+  header_put(&writer, hlit - 257, 5);
+  header_put(&writer, hdist - 1, 5);
+  header_put(&writer, hclen - 4, 4);
+
+  for (n = 0; n < hclen; n++)
+  {
+    header_put(&writer, coding[deflate_hclen_map[n]].length, 3);
+  }
+
+  for (n = 0; n < symbol_count; n++)
+  {
+    const int symbol = symbols[n];
+
+    header_put(&writer, coding[symbol].code, coding[symbol].length);
+
+    switch (symbol)
+    {
+      case 16: header_put(&writer, extra[n], 2); break;
+      case 17: header_put(&writer, extra[n], 3); break;
+      case 18: header_put(&writer, extra[n], 7); break;
+      default: break;
+    }
+  }
+
+  table->header_length = writer.length;
+  table->header_tail.holding = writer.holding;
+  table->header_tail.length = writer.bits;
+
   return 0;
 }
 
+void dynamic_huffman_write_header(
+  struct _kohnz *kohnz,
+  const struct _kohnz_table *table)
+{
+  write_bit_stream(
+    kohnz,
+    table->header,
+    table->header_length,
+    &table->header_tail);
+
+  STATS_ADD(
+    kohnz,
+    header_bits,
+    table->header_length * 8 + table->header_tail.length);
+}
+
 int dynamic_huffman_build(
   struct _kohnz *kohnz,
   uint16_t *literals_sorted,
@@ -77,121 +464,255 @@ int dynamic_huffman_build(
   int literals_count,
   int distances_count)
 {
-  struct _huffman coding[19];
-  uint16_t next_code[16];
-  int n, length, count, highest_length = 0;
-  int used_lengths[16];
+  struct _kohnz_table *table = kohnz->dynamic;
+  uint32_t literals[286];
+  uint32_t distances[30];
+  int n;
 
-  memset(coding, 0, sizeof(coding));
-  memset(kohnz->literals, 0, sizeof(kohnz->literals));
-  memset(kohnz->distances, 0, sizeof(kohnz->distances));
-  memset(next_code, 0, sizeof(next_code));
-  memset(used_lengths, 0, sizeof(used_lengths));
+  memset(literals, 0, sizeof(literals));
+  memset(distances, 0, sizeof(distances));
 
-  kohnz->literals_length = 0;
-  kohnz->distances_length = 0;
+  // The symbols are sorted most used first, so give each one a made up
+  // count that drops with its position.  A symbol listed more than once
+  // keeps its first position.
+  for (n = 0; n < literals_count; n++)
+  {
+    const int symbol = literals_sorted[n];
 
-  // Compute lengths for the literal table
-  length = 2;
-  count = 0;
+    if (symbol >= 286) { return -1; }
+    if (literals[symbol] == 0) { literals[symbol] = literals_count - n; }
+  }
 
-  for (n = 0; n < literals_count; n++)
+  for (n = 0; n < distances_count; n++)
   {
-    const int index = literals_sorted[n];
+    const int symbol = distances_sorted[n];
 
-    if (index + 1 > kohnz->literals_length)
-    {
-      kohnz->literals_length = index + 1;
-    }
+    if (symbol >= 30) { return -1; }
+    if (distances[symbol] == 0) { distances[symbol] = distances_count - n; }
+  }
 
-    kohnz->literals[n].length = length;
-    used_lengths[length]++;
+  // Every block ends with literal 256.
+  if (literals[256] == 0) { literals[256] = 1; }
 
-    count++;
+  dynamic_huffman_lengths(literals, table->literals, 286, kohnz->max_code_length);
+  dynamic_huffman_lengths(distances, table->distances, 30, kohnz->max_code_length);
+  dynamic_huffman_codes(table->literals, 286);
+  dynamic_huffman_codes(table->distances, 30);
+  dynamic_huffman_header(table);
 
-    if (count == (1 << (length - 1)) + 1)
-    {
-      length++;
-      count = 0;
-    }
+  dynamic_huffman_write_header(kohnz, table);
+
+  return 0;
+}
+
+void kohnz_histogram_init(struct _kohnz_histogram *histogram)
+{
+  memset(histogram, 0, sizeof(struct _kohnz_histogram));
+}
+
+void kohnz_histogram_add_literals(
+  struct _kohnz_histogram *histogram,
+  const uint8_t *data,
+  int length)
+{
+  int n;
+
+  for (n = 0; n < length; n++)
+  {
+    histogram->literals[data[n]]++;
   }
+}
 
-  highest_length = length;
+int kohnz_histogram_add_match(
+  struct _kohnz_histogram *histogram,
+  int distance,
+  int length)
+{
+  if (length < 3 || length > 258) { return -1; }
+  if (distance < 1 || distance > 32768) { return -1; }
 
-  if (kohnz->literals_length < 257) { kohnz->literals_length = 257; }
+  histogram->literals[deflate_length_table[length].code]++;
+  histogram->distances[deflate_distance_lookup(distance)]++;
 
-  // Compute lengths for the distance table
-  length = 2;
-  count = 0;
+  return 0;
+}
 
-  for (n = 0; n < distances_count; n++)
+int kohnz_histogram_add_sample(
+  struct _kohnz_histogram *histogram,
+  const uint8_t *data,
+  int length)
+{
+  struct _kohnz kohnz;
+  struct _matcher *matcher;
+  int ret;
+
+  // The matcher only needs the offsets from the context, nothing is
+  // written to it.
+  memset(&kohnz, 0, sizeof(kohnz));
+
+  kohnz_allocator_get(&kohnz.allocator);
+
+  matcher = matcher_create(&kohnz.allocator);
+
+  if (matcher == NULL) { return -1; }
+
+  matcher->histogram = histogram;
+
+  ret = matcher_compress(&kohnz, matcher, data, length);
+
+  matcher_destroy(matcher);
+
+  return ret;
+}
+
+int kohnz_table_build(
+  struct _kohnz_table *table,
+  const struct _kohnz_histogram *histogram)
+{
+  return kohnz_table_build_limited(table, histogram, DYNAMIC_MAX_BITS, NULL);
+}
+
+int kohnz_table_build_limited(
+  struct _kohnz_table *table,
+  const struct _kohnz_histogram *histogram,
+  int max_code_length,
+  uint64_t *cost)
+{
+  uint32_t literals[286];
+  uint32_t distances[30];
+  int n;
+
+  if (max_code_length < DYNAMIC_MIN_LIMIT || max_code_length > DYNAMIC_MAX_BITS)
   {
-    const int index = distances_sorted[n];
+    return -1;
+  }
 
-    if (index + 1 > kohnz->distances_length)
-    {
-      kohnz->distances_length = index + 1;
-    }
+  // A table that's going to be reused has to be able to encode anything,
+  // so symbols that never showed up in the sample still get a code.
+  for (n = 0; n < 286; n++)
+  {
+    literals[n] = histogram->literals[n] == 0 ? 1 : histogram->literals[n];
+  }
 
-    kohnz->distances[n].length = length;
-    used_lengths[length]++;
+  for (n = 0; n < 30; n++)
+  {
+    distances[n] = histogram->distances[n] == 0 ? 1 : histogram->distances[n];
+  }
 
-    count++;
+  dynamic_huffman_lengths(literals, table->literals, 286, max_code_length);
+  dynamic_huffman_lengths(distances, table->distances, 30, max_code_length);
 
-    if (count == (1 << (length - 1)) + 1)
-    {
-      length++;
-      count = 0;
-    }
+  if (cost != NULL)
+  {
+    *cost =
+      dynamic_huffman_limit_cost(literals, table->literals, 286) +
+      dynamic_huffman_limit_cost(distances, table->distances, 30);
   }
 
-  if (kohnz->distances_length < 257) { kohnz->distances_length = 1; }
+  dynamic_huffman_codes(table->literals, 286);
+  dynamic_huffman_codes(table->distances, 30);
+
+  return dynamic_huffman_header(table);
+}
+
+int kohnz_table_save(
+  const struct _kohnz_table *table,
+  uint8_t *blob,
+  int length)
+{
+  const int count = table->literals_length + table->distances_length;
+  const int size = 5 + (count + 1) / 2;
+  int n;
+
+  if (blob == NULL) { return size; }
+  if (length < size) { return -1; }
+
+  // Only the code lengths are stored, 4 bits each.  Everything else is
+  // rebuilt from them when the table is loaded.
+  blob[0] = TABLE_MAGIC_0;
+  blob[1] = TABLE_MAGIC_1;
+  blob[2] = TABLE_VERSION;
+  blob[3] = table->literals_length - 257;
+  blob[4] = table->distances_length - 1;
+
+  memset(blob + 5, 0, size - 5);
+
+  for (n = 0; n < count; n++)
+  {
+    const int code_length = n < table->literals_length ?
+      table->literals[n].length :
+      table->distances[n - table->literals_length].length;
 
-  if (highest_length < length) { highest_length = length; }
-  if (used_lengths[highest_length] == 0) { highest_length--; }
+    blob[5 + (n >> 1)] |= code_length << ((n & 1) * 4);
+  }
 
-  build_huffman_values(kohnz->literals, kohnz->literals_length);
-  build_huffman_values(kohnz->distances, kohnz->distances_length);
+  return size;
+}
 
-  int coding_count = 0;
+static int is_complete(const struct _huffman *table, int table_length)
+{
+  uint32_t total = 0;
+  int n;
 
-  if (used_lengths[highest_length - 1] > used_lengths[highest_length])
+  for (n = 0; n < table_length; n++)
   {
-    coding[coding_count++].length = highest_length - 1;
-    coding[coding_count++].length = highest_length;
-    highest_length -= 2;
+    if (table[n].length != 0)
+    {
+      total += 1 << (DYNAMIC_MAX_BITS - table[n].length);
+    }
   }
 
-  // Find the best sizes for huffman tree that compresses the
-  // literal and distance trees.
-  for (n = highest_length; n >= 1; n--)
+  return total == (1 << DYNAMIC_MAX_BITS);
+}
+
+int kohnz_table_load(
+  struct _kohnz_table *table,
+  const uint8_t *blob,
+  int length)
+{
+  int hlit, hdist, count, n;
+
+  if (length < 5) { return -1; }
+
+  if (blob[0] != TABLE_MAGIC_0 ||
+      blob[1] != TABLE_MAGIC_1 ||
+      blob[2] != TABLE_VERSION)
   {
-    if (used_lengths[n] == 0) { continue; }
-    coding[coding_count++].length = highest_length;
+    return -1;
   }
 
-  coding[coding_count++].length = 16;
-  coding[coding_count++].length = 17;
-  coding[coding_count++].length = 18;
+  hlit = blob[3] + 257;
+  hdist = blob[4] + 1;
+  count = hlit + hdist;
+
+  if (hlit > 286 || hdist > 30) { return -1; }
+  if (length < 5 + (count + 1) / 2) { return -1; }
+
+  memset(table->literals, 0, sizeof(table->literals));
+  memset(table->distances, 0, sizeof(table->distances));
 
-  build_huffman_values(coding, coding_count);
+  for (n = 0; n < count; n++)
+  {
+    const int code_length = (blob[5 + (n >> 1)] >> ((n & 1) * 4)) & 0xf;
 
-  // Going to waste some bits for now.  Can optimize later, but it seems
-  // like a waste of CPU for a few extra bits.
-  const int hclen = 19 - 4;
-  const int hdist = kohnz->distances_length - 1;
-  const int hlit = kohnz->literals_length - 257;
+    if (n < hlit)
+    {
+      table->literals[n].length = code_length;
+    }
+      else
+    {
+      table->distances[n - hlit].length = code_length;
+    }
+  }
 
-//#if 0
-printf("hclen: %d\n", hclen + 4);
-printf("hdist: %d\n", hdist + 1);
-printf("hlit: %d\n", hlit + 257);
-//#endif
+  // Don't trust the blob to describe a code a decompressor will accept.
+  if (table->literals[256].length == 0) { return -1; }
+  if (!is_complete(table->literals, 286)) { return -1; }
+  if (!is_complete(table->distances, 30)) { return -1; }
 
-  write_bits(kohnz, deflate_reverse[hlit] >> 3, 5);
-  write_bits(kohnz, deflate_reverse[hdist] >> 3, 5);
-  write_bits(kohnz, deflate_reverse[hclen] >> 4, 4);
+  dynamic_huffman_codes(table->literals, 286);
+  dynamic_huffman_codes(table->distances, 30);
 
-  return 0;
+  return dynamic_huffman_header(table);
 }
 
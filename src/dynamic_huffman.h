@@ -17,6 +17,26 @@
 
 #include "kohnz.h"
 
+#define DYNAMIC_MAX_BITS 15
+#define DYNAMIC_MIN_LIMIT 9
+#define DYNAMIC_CODING_MAX_BITS 7
+
+int dynamic_huffman_lengths(
+  const uint32_t *counts,
+  struct _huffman *table,
+  int table_length,
+  int max_bits);
+
+uint64_t dynamic_huffman_limit_cost(
+  const uint32_t *counts,
+  const struct _huffman *table,
+  int table_length);
+
+void dynamic_huffman_codes(struct _huffman *table, int table_length);
+void dynamic_huffman_fixed(struct _kohnz_table *table);
+int dynamic_huffman_header(struct _kohnz_table *table);
+void dynamic_huffman_write_header(struct _kohnz *kohnz, const struct _kohnz_table *table);
+
 int dynamic_huffman_build(
   struct _kohnz *kohnz,
   uint16_t *literals_sorted,
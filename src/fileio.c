@@ -11,51 +11,188 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "alloc.h"
+#include "fileio.h"
 #include "kohnz.h"
+#include "kohnz_inline.h"
+#include "stats.h"
+#include "trace.h"
 
-int write16(FILE *out, uint32_t num)
+static int grow_buffer(struct _kohnz *kohnz, int needed)
 {
-  uint8_t data[2];
+  int size = kohnz->buffer_size;
 
-  data[0] = num;
-  data[1] = num >> 8;
+  if (size == 0) { size = KOHNZ_BUFFER_SIZE; }
 
-  fwrite(data, sizeof(data), 1, out);
+  while (size - kohnz->buffer_length < needed) { size *= 2; }
+
+  uint8_t *buffer = (uint8_t *)kohnz_alloc(&kohnz->allocator, size);
+
+  if (buffer == NULL)
+  {
+    kohnz->error = -1;
+    return -1;
+  }
+
+  // A shared record's buffer can be NULL after it's been handed off.
+  if (kohnz->buffer != NULL && kohnz->buffer_length != 0)
+  {
+    memcpy(buffer, kohnz->buffer, kohnz->buffer_length);
+  }
+
+  // A file context's first buffer is part of the context's allocation.
+  if (kohnz->buffer != NULL && kohnz->buffer != (uint8_t *)(kohnz + 1))
+  {
+    kohnz_free(&kohnz->allocator, kohnz->buffer);
+  }
+
+  kohnz->buffer = buffer;
+  kohnz->buffer_size = size;
 
   return 0;
 }
 
-int write32(FILE *out, uint32_t num)
+int write_buffer_flush(struct _kohnz *kohnz)
 {
-  uint8_t data[4];
+  // In memory mode the buffer is the output, so there is nowhere to
+  // flush it to.  While a snapshot is held the output has to stay in
+  // the buffer so it can be rolled back.
+  if (kohnz->out == NULL || kohnz->pinned != 0) { return 0; }
+
+  if (kohnz->buffer_length != 0)
+  {
+    TRACE_BEGIN(buffer_flush, start);
+
+    if (fwrite(kohnz->buffer, 1, kohnz->buffer_length, kohnz->out) !=
+        kohnz->buffer_length)
+    {
+      kohnz->error = -1;
+      return -1;
+    }
 
-  data[0] = num;
-  data[1] = num >> 8;
-  data[2] = num >> 16;
-  data[3] = num >> 24;
+    TRACE2(buffer_flush, kohnz->buffer_length, TRACE_ELAPSED(start));
+    STATS_ADD(kohnz, bytes_flushed, kohnz->buffer_length);
 
-  fwrite(data, sizeof(data), 1, out);
+    kohnz->buffer_length = 0;
+  }
 
   return 0;
 }
 
-void write_bits(struct _kohnz *kohnz, uint32_t data, int length)
+static int write_buffer_reserve(struct _kohnz *kohnz, int length)
 {
-  struct _bits *bits = &kohnz->bits;
+  if (kohnz->error != 0) { return -1; }
+
+  if (kohnz->out != NULL && kohnz->pinned == 0)
+  {
+    return write_buffer_flush(kohnz);
+  }
+    else
+  {
+    return grow_buffer(kohnz, length);
+  }
+}
+
+static inline uint64_t read64(const uint8_t *data)
+{
+  uint64_t value;
+
+  memcpy(&value, data, sizeof(value));
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  value = __builtin_bswap64(value);
+#endif
+
+  return value;
+}
+
+static inline void store64(uint8_t *data, uint64_t value)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  value = __builtin_bswap64(value);
+#endif
+
+  memcpy(data, &value, sizeof(value));
+}
+
+int kohnz_buffer_reserve(struct _kohnz *kohnz, int length)
+{
+  return write_buffer_reserve(kohnz, length);
+}
+
+void write8(struct _kohnz *kohnz, uint8_t num)
+{
+  if (kohnz->buffer_length == kohnz->buffer_size &&
+      write_buffer_reserve(kohnz, 1) != 0)
+  {
+    return;
+  }
+
+  kohnz->buffer[kohnz->buffer_length++] = num;
+}
+
+int write16(struct _kohnz *kohnz, uint32_t num)
+{
+  write8(kohnz, num);
+  write8(kohnz, num >> 8);
+
+  return 0;
+}
+
+int write32(struct _kohnz *kohnz, uint32_t num)
+{
+  write8(kohnz, num);
+  write8(kohnz, num >> 8);
+  write8(kohnz, num >> 16);
+  write8(kohnz, num >> 24);
+
+  return 0;
+}
+
+int write_data(struct _kohnz *kohnz, const uint8_t *data, int length)
+{
+  if (kohnz->error != 0) { return -1; }
+
+  if (kohnz->buffer_size - kohnz->buffer_length >= length)
+  {
+    memcpy(kohnz->buffer + kohnz->buffer_length, data, length);
+    kohnz->buffer_length += length;
 
-  bits->holding |= data << bits->length;
-  bits->length += length;
+    return 0;
+  }
 
-  while(bits->length >= 8)
+  if (kohnz->out != NULL && kohnz->pinned == 0)
   {
-    const int byte = bits->holding & 0xff;
+    // Too big for the buffer, so write it straight to the file.
+    if (write_buffer_flush(kohnz) != 0) { return -1; }
+
+    TRACE_BEGIN(write_direct, start);
+
+    if (fwrite(data, 1, length, kohnz->out) != length)
+    {
+      kohnz->error = -1;
+      return -1;
+    }
 
-    putc(byte, kohnz->out);
+    TRACE2(write_direct, length, TRACE_ELAPSED(start));
+    STATS_ADD(kohnz, bytes_flushed, length);
 
-    bits->holding >>= 8;
-    bits->length -= 8;
+    return 0;
   }
+
+  if (grow_buffer(kohnz, length) != 0) { return -1; }
+
+  memcpy(kohnz->buffer + kohnz->buffer_length, data, length);
+  kohnz->buffer_length += length;
+
+  return 0;
+}
+
+void write_bits(struct _kohnz *kohnz, uint32_t data, int length)
+{
+  kohnz_write_bits_inline(kohnz, data, length);
 }
 
 void write_bits_end_block(struct _kohnz *kohnz)
@@ -66,6 +203,133 @@ void write_bits_end_block(struct _kohnz *kohnz)
 
   uint8_t data = bits->holding & ((1 << bits->length) - 1);
 
-  putc(data, kohnz->out);
+  write8(kohnz, data);
+
+  bits->holding = 0;
+  bits->length = 0;
+}
+
+void write_empty_stored_block(struct _kohnz *kohnz)
+{
+  // final=0, type=0 (stored), then pad to a byte boundary and write
+  // LEN=0 and NLEN=0xffff.
+  write_bits(kohnz, 0, 3);
+  write_bits_end_block(kohnz);
+  write16(kohnz, 0x0000);
+  write16(kohnz, 0xffff);
+
+  STATS_ADD(kohnz, blocks[0], 1);
+}
+
+int write_huffman_literals(
+  struct _kohnz *kohnz,
+  const struct _huffman *table,
+  const uint8_t *data,
+  int length)
+{
+  struct _bits *bits = &kohnz->bits;
+  uint64_t holding = bits->holding;
+  int count = bits->length;
+  int n = 0;
+
+  // Codes are at most 15 bits, so two of them fit on top of up to 31
+  // bits that are being held.  32 bits go out at a time as a 64 bit
+  // store, which is why 8 bytes of room are needed.
+  while (n < length)
+  {
+    if (kohnz->buffer_size - kohnz->buffer_length < 8)
+    {
+      if (write_buffer_reserve(kohnz, 8) != 0) { return -1; }
+    }
+
+    const struct _huffman *a = &table[data[n++]];
+
+    holding |= (uint64_t)a->code << count;
+    count += a->length;
+
+    if (n < length)
+    {
+      const struct _huffman *b = &table[data[n++]];
+
+      holding |= (uint64_t)b->code << count;
+      count += b->length;
+    }
+
+    if (count >= 32)
+    {
+      store64(kohnz->buffer + kohnz->buffer_length, holding);
+      kohnz->buffer_length += 4;
+      holding >>= 32;
+      count -= 32;
+    }
+  }
+
+  while (count >= 8)
+  {
+    write8(kohnz, holding & 0xff);
+    holding >>= 8;
+    count -= 8;
+  }
+
+  bits->holding = holding;
+  bits->length = count;
+
+  return 0;
+}
+
+int write_bit_stream(
+  struct _kohnz *kohnz,
+  const uint8_t *data,
+  int length,
+  const struct _bits *tail)
+{
+  struct _bits *bits = &kohnz->bits;
+  const int shift = bits->length;
+  uint64_t carry;
+  uint64_t value;
+
+  if (shift == 0)
+  {
+    if (write_data(kohnz, data, length) != 0) { return -1; }
+  }
+    else
+  {
+    // Each 64 bit word of the stream is shifted up past the bits that are
+    // still being held and the top of it is carried into the next word.
+    carry = bits->holding & ((1 << shift) - 1);
+
+    while (length >= 8)
+    {
+      if (kohnz->buffer_size - kohnz->buffer_length < 8)
+      {
+        if (write_buffer_reserve(kohnz, 8) != 0) { return -1; }
+      }
+
+      value = read64(data);
+
+      store64(kohnz->buffer + kohnz->buffer_length, carry | (value << shift));
+      carry = value >> (64 - shift);
+
+      kohnz->buffer_length += 8;
+      data += 8;
+      length -= 8;
+    }
+
+    bits->holding = carry;
+
+    while (length > 0)
+    {
+      write_bits(kohnz, *data, 8);
+      data++;
+      length--;
+    }
+  }
+
+  if (tail->length != 0)
+  {
+    write_bits(kohnz, tail->holding & ((1 << tail->length) - 1), tail->length);
+  }
+
+  return 0;
 }
 
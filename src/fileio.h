@@ -9,11 +9,35 @@
  *
  */
 
+#ifndef _FILEIO_H
+#define _FILEIO_H
+
 #include <stdio.h>
 #include <stdlib.h>
 
-int write16(FILE *out, uint32_t num);
-int write32(FILE *out, uint32_t num);
+#include "kohnz.h"
+
+int write_buffer_flush(struct _kohnz *kohnz);
+void write8(struct _kohnz *kohnz, uint8_t num);
+int write16(struct _kohnz *kohnz, uint32_t num);
+int write32(struct _kohnz *kohnz, uint32_t num);
+int write_data(struct _kohnz *kohnz, const uint8_t *data, int length);
+
+int write_huffman_literals(
+  struct _kohnz *kohnz,
+  const struct _huffman *table,
+  const uint8_t *data,
+  int length);
+
+int write_bit_stream(
+  struct _kohnz *kohnz,
+  const uint8_t *data,
+  int length,
+  const struct _bits *tail);
+
 void write_bits(struct _kohnz *kohnz, uint32_t data, int length);
 void write_bits_end_block(struct _kohnz *kohnz);
+void write_empty_stored_block(struct _kohnz *kohnz);
+
+#endif
 
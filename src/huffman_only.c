@@ -0,0 +1,229 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "dynamic_huffman.h"
+#include "fileio.h"
+#include "huffman_only.h"
+#include "stats.h"
+
+static void histogram(uint32_t *counts, const uint8_t *data, int length)
+{
+  uint32_t partial[4][256];
+  int n;
+
+  // Incrementing the same counter twice in a row stalls on the store
+  // from the first one, which is common with text.  Spreading bytes over
+  // 4 sets of counters keeps back to back increments apart.
+  memset(partial, 0, sizeof(partial));
+
+  for (n = 0; n + 4 <= length; n += 4)
+  {
+    uint32_t value;
+
+    memcpy(&value, data + n, sizeof(value));
+
+    partial[0][value & 0xff]++;
+    partial[1][(value >> 8) & 0xff]++;
+    partial[2][(value >> 16) & 0xff]++;
+    partial[3][value >> 24]++;
+  }
+
+  for (; n < length; n++) { partial[0][data[n]]++; }
+
+  for (n = 0; n < 256; n++)
+  {
+    counts[n] = partial[0][n] + partial[1][n] + partial[2][n] + partial[3][n];
+  }
+}
+
+static uint64_t literal_cost(const struct _huffman *table, const uint32_t *counts)
+{
+  uint64_t cost = 0;
+  int n;
+
+  for (n = 0; n < 256; n++)
+  {
+    cost += (uint64_t)counts[n] * table[n].length;
+  }
+
+  return cost + table[256].length;
+}
+
+static int write_block(
+  struct _kohnz *kohnz,
+  const uint8_t *data,
+  int length,
+  int is_final)
+{
+  struct _huffman_only *huffman_only = kohnz->huffman_only;
+  struct _kohnz_table *table = &huffman_only->table;
+  const struct _kohnz_table *use;
+  uint32_t counts[286];
+  uint32_t distances[30];
+  uint64_t dynamic_bits, fixed_bits, stored_bits;
+
+  memset(counts, 0, sizeof(counts));
+  memset(distances, 0, sizeof(distances));
+
+  histogram(counts, data, length);
+
+  // Every block ends with literal 256.
+  counts[256] = 1;
+
+  dynamic_huffman_lengths(counts, table->literals, 286, kohnz->max_code_length);
+  dynamic_huffman_lengths(distances, table->distances, 30, kohnz->max_code_length);
+  dynamic_huffman_codes(table->literals, 286);
+  dynamic_huffman_codes(table->distances, 30);
+  dynamic_huffman_header(table);
+
+  dynamic_bits =
+    table->header_length * 8 + table->header_tail.length +
+    literal_cost(table->literals, counts);
+
+  fixed_bits = literal_cost(huffman_only->fixed.literals, counts);
+
+  // The 3 bit block header, padding to a byte, then LEN and NLEN.
+  stored_bits = ((8 - (kohnz->bits.length + 3) % 8) % 8) + 32;
+  stored_bits += (uint64_t)length * 8;
+
+  write_bits(kohnz, is_final == 0 ? 0 : 1, 1);
+
+  if (stored_bits <= dynamic_bits && stored_bits <= fixed_bits)
+  {
+    write_bits(kohnz, 0, 2);
+    write_bits_end_block(kohnz);
+    write16(kohnz, length);
+    write16(kohnz, length ^ 0xffff);
+
+    STATS_ADD(kohnz, blocks[0], 1);
+    STATS_ADD(kohnz, stored_bytes, length);
+
+    return write_data(kohnz, data, length);
+  }
+
+  if (dynamic_bits < fixed_bits)
+  {
+    use = table;
+    write_bits(kohnz, 2, 2);
+    STATS_ADD(kohnz, blocks[2], 1);
+    dynamic_huffman_write_header(kohnz, table);
+
+    if (kohnz->max_code_length < DYNAMIC_MAX_BITS)
+    {
+      kohnz->code_length_cost +=
+        dynamic_huffman_limit_cost(counts, table->literals, 286);
+    }
+  }
+    else
+  {
+    use = &huffman_only->fixed;
+    write_bits(kohnz, 1, 2);
+    STATS_ADD(kohnz, blocks[1], 1);
+  }
+
+  STATS_BEGIN(kohnz);
+
+  if (write_huffman_literals(kohnz, use->literals, data, length) != 0)
+  {
+    return -1;
+  }
+
+  STATS_ADD(kohnz, literals, length);
+  STATS_END(kohnz, literal_bits);
+
+  write_bits(kohnz, use->literals[256].code, use->literals[256].length);
+
+  if (is_final != 0) { write_bits_end_block(kohnz); }
+
+  return 0;
+}
+
+struct _huffman_only *huffman_only_create(const struct _kohnz_allocator *allocator)
+{
+  struct _huffman_only *huffman_only;
+
+  huffman_only =
+    (struct _huffman_only *)kohnz_alloc(allocator, sizeof(struct _huffman_only));
+
+  if (huffman_only == NULL) { return NULL; }
+
+  dynamic_huffman_fixed(&huffman_only->fixed);
+
+  huffman_only_reset(huffman_only);
+
+  return huffman_only;
+}
+
+void huffman_only_reset(struct _huffman_only *huffman_only)
+{
+  huffman_only->length = 0;
+}
+
+int huffman_only_write(struct _kohnz *kohnz, const uint8_t *data, int length)
+{
+  struct _huffman_only *huffman_only = kohnz->huffman_only;
+  int count;
+
+  while (length > 0)
+  {
+    // Whole blocks can be written straight from the caller's data
+    // without copying it first.
+    if (huffman_only->length == 0 && length >= HUFFMAN_ONLY_BLOCK_SIZE)
+    {
+      if (write_block(kohnz, data, HUFFMAN_ONLY_BLOCK_SIZE, 0) != 0)
+      {
+        return -1;
+      }
+
+      data += HUFFMAN_ONLY_BLOCK_SIZE;
+      length -= HUFFMAN_ONLY_BLOCK_SIZE;
+      continue;
+    }
+
+    count = HUFFMAN_ONLY_BLOCK_SIZE - huffman_only->length;
+
+    if (count > length) { count = length; }
+
+    memcpy(huffman_only->data + huffman_only->length, data, count);
+    huffman_only->length += count;
+
+    data += count;
+    length -= count;
+
+    if (huffman_only->length == HUFFMAN_ONLY_BLOCK_SIZE)
+    {
+      if (huffman_only_emit(kohnz, 0) != 0) { return -1; }
+    }
+  }
+
+  return 0;
+}
+
+int huffman_only_emit(struct _kohnz *kohnz, int is_final)
+{
+  struct _huffman_only *huffman_only = kohnz->huffman_only;
+  int ret;
+
+  // A non-final block with nothing in it would only waste bits.
+  if (huffman_only->length == 0 && is_final == 0) { return 0; }
+
+  ret = write_block(kohnz, huffman_only->data, huffman_only->length, is_final);
+
+  huffman_only->length = 0;
+
+  return ret;
+}
+
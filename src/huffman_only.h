@@ -0,0 +1,37 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ */
+
+#ifndef _HUFFMAN_ONLY_H
+#define _HUFFMAN_ONLY_H
+
+#include <stdint.h>
+
+#include "kohnz.h"
+
+// Largest amount of data a stored block can hold, so any block can fall
+// back to being stored if the data doesn't compress.
+#define HUFFMAN_ONLY_BLOCK_SIZE 65535
+
+struct _huffman_only
+{
+  int length;
+  struct _kohnz_table table;
+  struct _kohnz_table fixed;
+  uint8_t data[HUFFMAN_ONLY_BLOCK_SIZE];
+};
+
+struct _huffman_only *huffman_only_create(const struct _kohnz_allocator *allocator);
+void huffman_only_reset(struct _huffman_only *huffman_only);
+int huffman_only_write(struct _kohnz *kohnz, const uint8_t *data, int length);
+int huffman_only_emit(struct _kohnz *kohnz, int is_final);
+
+#endif
+
@@ -12,259 +12,1718 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "adler32.h"
+#include "alloc.h"
+#include "auto_block.h"
+#include "bgzf.h"
 #include "crc32.h"
 #include "deflate_codes.h"
 #include "dynamic_huffman.h"
 #include "fileio.h"
+#include "huffman_only.h"
 #include "kohnz.h"
+#include "matcher.h"
+#include "stats.h"
+#include "trace.h"
+
+#define CHECKPOINT_MAGIC_0 'K'
+#define CHECKPOINT_MAGIC_1 'C'
+#define CHECKPOINT_VERSION 1
+
+#ifdef KOHNZ_TRACE
+TRACE_SEMAPHORE(block_start);
+TRACE_SEMAPHORE(block_end);
+TRACE_SEMAPHORE(flush);
+TRACE_SEMAPHORE(close);
+TRACE_SEMAPHORE(buffer_flush);
+TRACE_SEMAPHORE(write_direct);
+#endif
+
+static uint64_t get_time_ns()
+{
+  struct timespec tp;
+
+  clock_gettime(CLOCK_MONOTONIC, &tp);
+
+  return (uint64_t)tp.tv_sec * 1000000000 + tp.tv_nsec;
+}
+
+static void check_flush_policy(struct _kohnz *kohnz)
+{
+  struct _flush_policy *flush_policy = &kohnz->flush_policy;
+
+  // A final block can't be followed by a stored block, so there is
+  // nothing the policy can do until the stream is closed.
+  if (kohnz->is_final != 0) { return; }
+
+  if (flush_policy->max_bytes != 0 &&
+      kohnz->file_size - flush_policy->last_offset >= flush_policy->max_bytes)
+  {
+    kohnz_flush(kohnz, flush_policy->type);
+    return;
+  }
+
+  if (flush_policy->max_ns != 0 &&
+      get_time_ns() - flush_policy->last_time >= flush_policy->max_ns)
+  {
+    kohnz_flush(kohnz, flush_policy->type);
+  }
+}
+
+void kohnz_check_flush_policy(struct _kohnz *kohnz)
+{
+  check_flush_policy(kohnz);
+}
 
 void kohnz_init()
 {
-  kohnz_crc32_init();
-  deflate_length_table_init();
-  deflate_distance_table_init();
+  // All lookup tables are const data now so there is nothing to set up.
+  // This is kept so older programs still link.
+}
+
+static void reset_state(struct _kohnz *kohnz)
+{
+  kohnz->buffer_length = 0;
+  kohnz->bits.holding = 0;
+  kohnz->bits.length = 0;
+  kohnz->file_size = 0;
+  kohnz->crc32 = 0xffffffff;
+  kohnz->adler32 = 1;
+  kohnz->mode = MODE_UNCOMPRESSED;
+  kohnz->in_block = 0;
+  kohnz->is_final = 0;
+  kohnz->window_start = 0;
+  kohnz->code_length_cost = 0;
+  kohnz->flush_policy.last_offset = 0;
+
+  // A new stream starts with no write error, and snapshots of the old
+  // one can't be restored (releasing them afterwards does nothing).
+  kohnz->error = 0;
+  kohnz->pinned = 0;
+
+  if (kohnz->flush_policy.max_ns != 0)
+  {
+    kohnz->flush_policy.last_time = get_time_ns();
+  }
+
+  if (kohnz->matcher != NULL) { matcher_reset(kohnz->matcher); }
+  if (kohnz->auto_block != NULL) { auto_block_reset(kohnz->auto_block); }
+
+  if (kohnz->huffman_only != NULL)
+  {
+    huffman_only_reset(kohnz->huffman_only);
+  }
+}
+
+static int open_file(struct _kohnz *kohnz, const char *filename)
+{
+  reset_state(kohnz);
+
+  kohnz->out = fopen(filename, "wb");
+
+  if (kohnz->out == NULL) { return -1; }
+
+  // Output is collected in kohnz->buffer so stdio doesn't need its own.
+  setvbuf(kohnz->out, NULL, _IONBF, 0);
+
+  return 0;
+}
+
+static void write_gzip_header(
+  struct _kohnz *kohnz,
+  const char *fname,
+  const char *fcomment)
+{
+  uint8_t flags = 0;
+
+  if (fname != NULL && fname[0] != 0) { flags |= 0x08; }
+  if (fcomment != NULL && fcomment[0] != 0) { flags |= 0x10; }
+
+  // Magic number
+  write8(kohnz, 0x1f);
+  write8(kohnz, 0x8b);
+  // Compression method 8 (DEFLATE)
+  write8(kohnz, 0x08);
+  write8(kohnz, flags);
+  // Timestamp
+  write32(kohnz, 0);
+  // Compression flags
+  write8(kohnz, 0x02);
+  // Operating system (3 is Unix)
+  write8(kohnz, 0x03);
+
+  if (fname != NULL && fname[0] != 0)
+  {
+    write_data(kohnz, (const uint8_t *)fname, strlen(fname) + 1);
+  }
+
+  if (fcomment != NULL && fcomment[0] != 0)
+  {
+    write_data(kohnz, (const uint8_t *)fcomment, strlen(fcomment) + 1);
+  }
+}
+
+static void write_zlib_header(struct _kohnz *kohnz)
+{
+  // CMF: method 8 (DEFLATE) with a 32k window.  FLG: no dictionary and
+  // FCHECK set so that CMF * 256 + FLG is a multiple of 31.
+  const uint8_t cmf = 0x78;
+  uint8_t flg = 0x00;
+
+  flg |= (31 - ((cmf << 8) | flg) % 31) % 31;
+
+  write8(kohnz, cmf);
+  write8(kohnz, flg);
+}
+
+static void write_header(
+  struct _kohnz *kohnz,
+  const char *fname,
+  const char *fcomment)
+{
+  switch (kohnz->container)
+  {
+    case KOHNZ_CONTAINER_GZIP:
+      write_gzip_header(kohnz, fname, fcomment);
+      break;
+    case KOHNZ_CONTAINER_ZLIB:
+      write_zlib_header(kohnz);
+      break;
+    default:
+      break;
+  }
+}
+
+static int close_file(struct _kohnz *kohnz)
+{
+  int ret = 0;
+  TRACE_BEGIN(close, start);
+
+  // Nothing can be rolled back once the file is closed.
+  kohnz->pinned = 0;
+
+  if (kohnz->container == KOHNZ_CONTAINER_BGZF)
+  {
+    // BGZF writes each member as it goes, so only the last partial one
+    // and the EOF marker are left.
+    ret = bgzf_close(kohnz);
+  }
+    else
+  {
+    // A block that was left open is ended first.  Auto and huffman only
+    // blocks can still be holding data that hasn't been written.
+    if (kohnz->in_block != 0)
+    {
+      switch (kohnz->mode)
+      {
+        case MODE_STATIC_HUFFMAN: kohnz_end_fixed_block(kohnz); break;
+        case MODE_DYNAMIC_HUFFMAN: kohnz_end_dynamic_block(kohnz); break;
+        case MODE_AUTO: kohnz_end_auto_block(kohnz); break;
+        case MODE_HUFFMAN_ONLY: kohnz_end_huffman_block(kohnz); break;
+        default: break;
+      }
+    }
+
+    // No block was marked final (for example when the stream was written
+    // as a series of flushed blocks), so terminate it with an empty one.
+    if (kohnz->is_final == 0)
+    {
+      kohnz_start_fixed_block(kohnz, 1);
+      kohnz_end_fixed_block(kohnz);
+    }
+  }
+
+  if (kohnz->container == KOHNZ_CONTAINER_GZIP)
+  {
+    write32(kohnz, kohnz->crc32 ^ 0xffffffff);
+    write32(kohnz, kohnz->file_size);
+  }
+    else
+  if (kohnz->container == KOHNZ_CONTAINER_ZLIB)
+  {
+    // zlib stores the Adler-32 big endian.
+    write8(kohnz, kohnz->adler32 >> 24);
+    write8(kohnz, kohnz->adler32 >> 16);
+    write8(kohnz, kohnz->adler32 >> 8);
+    write8(kohnz, kohnz->adler32);
+  }
+
+  if (write_buffer_flush(kohnz) != 0) { ret = -1; }
+  if (kohnz->error != 0) { ret = -1; }
+
+  if (fclose(kohnz->out) != 0) { ret = -1; }
+
+  TRACE2(close, kohnz->file_size, TRACE_ELAPSED(start));
+
+  kohnz->out = NULL;
+
+  return ret;
+}
+
+// The context is allocated with buffer_size bytes after it for the
+// output buffer.  allocator is NULL for the one installed right now.
+static struct _kohnz *alloc_context(
+  const struct _kohnz_allocator *allocator,
+  int buffer_size)
+{
+  struct _kohnz_allocator current;
+  struct _kohnz *kohnz;
+
+  if (allocator == NULL)
+  {
+    kohnz_allocator_get(&current);
+    allocator = &current;
+  }
+
+  kohnz = (struct _kohnz *)kohnz_alloc(
+    allocator,
+    sizeof(struct _kohnz) + buffer_size);
+
+  if (kohnz == NULL) { return NULL; }
+
+  memset(kohnz, 0, sizeof(struct _kohnz));
+
+  kohnz->allocator = *allocator;
+  kohnz->max_code_length = DYNAMIC_MAX_BITS;
+
+  return kohnz;
+}
+
+struct _kohnz *kohnz_open(const char *filename, const char *fname, const char *fcomment)
+{
+  return kohnz_open_container(filename, KOHNZ_CONTAINER_GZIP, fname, fcomment);
+}
+
+struct _kohnz *kohnz_open_container(
+  const char *filename,
+  int container,
+  const char *fname,
+  const char *fcomment)
+{
+  struct _kohnz *kohnz;
+
+  if (container == KOHNZ_CONTAINER_BGZF)
+  {
+    return kohnz_open_bgzf(filename, NULL);
+  }
+
+  if (container != KOHNZ_CONTAINER_GZIP &&
+      container != KOHNZ_CONTAINER_ZLIB &&
+      container != KOHNZ_CONTAINER_RAW)
+  {
+    return NULL;
+  }
+
+  // The output buffer is part of the same allocation as the context.
+  kohnz = alloc_context(NULL, KOHNZ_BUFFER_SIZE);
+
+  if (kohnz == NULL) { return NULL; }
+
+  kohnz->buffer = (uint8_t *)(kohnz + 1);
+  kohnz->buffer_size = KOHNZ_BUFFER_SIZE;
+  kohnz->container = container;
+
+  if (open_file(kohnz, filename) != 0)
+  {
+    kohnz_free(&kohnz->allocator, kohnz);
+    return NULL;
+  }
+
+  write_header(kohnz, fname, fcomment);
+
+  return kohnz;
+}
+
+struct _kohnz *kohnz_open_bgzf(const char *filename, const char *index_filename)
+{
+  struct _kohnz *kohnz;
+
+  kohnz = alloc_context(NULL, KOHNZ_BUFFER_SIZE);
+
+  if (kohnz == NULL) { return NULL; }
+
+  kohnz->buffer = (uint8_t *)(kohnz + 1);
+  kohnz->buffer_size = KOHNZ_BUFFER_SIZE;
+  kohnz->container = KOHNZ_CONTAINER_BGZF;
+
+  if (open_file(kohnz, filename) != 0)
+  {
+    kohnz_free(&kohnz->allocator, kohnz);
+    return NULL;
+  }
+
+  if (bgzf_open(kohnz, index_filename) != 0)
+  {
+    fclose(kohnz->out);
+    kohnz_free(&kohnz->allocator, kohnz);
+    return NULL;
+  }
+
+  return kohnz;
+}
+
+struct _kohnz *kohnz_open_file(
+  FILE *out,
+  int container,
+  const char *fname,
+  const char *fcomment)
+{
+  struct _kohnz *kohnz;
+
+  if (container != KOHNZ_CONTAINER_GZIP &&
+      container != KOHNZ_CONTAINER_ZLIB &&
+      container != KOHNZ_CONTAINER_RAW &&
+      container != KOHNZ_CONTAINER_BGZF)
+  {
+    return NULL;
+  }
+
+  kohnz = alloc_context(NULL, KOHNZ_BUFFER_SIZE);
+
+  if (kohnz == NULL) { return NULL; }
+
+  kohnz->buffer = (uint8_t *)(kohnz + 1);
+  kohnz->buffer_size = KOHNZ_BUFFER_SIZE;
+  kohnz->container = container;
+
+  reset_state(kohnz);
+
+  // The stream is written from wherever it is now, nothing is truncated.
+  // It's closed by kohnz_close() like a file the library opened.
+  kohnz->out = out;
+
+  setvbuf(kohnz->out, NULL, _IONBF, 0);
+
+  if (container == KOHNZ_CONTAINER_BGZF)
+  {
+    // There is no index, since it would need a filename of its own.
+    if (bgzf_open(kohnz, NULL) != 0)
+    {
+      kohnz_free(&kohnz->allocator, kohnz);
+      return NULL;
+    }
+  }
+    else
+  {
+    write_header(kohnz, fname, fcomment);
+  }
+
+  return kohnz;
+}
+
+struct _kohnz *kohnz_open_memory()
+{
+  return kohnz_open_memory_with(NULL);
+}
+
+struct _kohnz *kohnz_open_memory_with(const struct _kohnz_allocator *allocator)
+{
+  struct _kohnz *kohnz;
+
+  kohnz = alloc_context(allocator, 0);
+
+  if (kohnz == NULL) { return NULL; }
+
+  kohnz->buffer = (uint8_t *)kohnz_alloc(&kohnz->allocator, KOHNZ_BUFFER_SIZE);
+
+  if (kohnz->buffer == NULL)
+  {
+    kohnz_free(&kohnz->allocator, kohnz);
+    return NULL;
+  }
+
+  kohnz->buffer_size = KOHNZ_BUFFER_SIZE;
+  kohnz->is_memory = 1;
+
+  reset_state(kohnz);
+
+  return kohnz;
+}
+
+int kohnz_reset(struct _kohnz *kohnz)
+{
+  // Only memory contexts can throw their output away.
+  if (kohnz->is_memory == 0) { return -1; }
+
+  reset_state(kohnz);
+
+  return 0;
+}
+
+uint8_t *kohnz_get_memory(struct _kohnz *kohnz, int *length)
+{
+  *length = kohnz->buffer_length;
+
+  return kohnz->buffer;
+}
+
+int kohnz_reopen(
+  struct _kohnz *kohnz,
+  const char *filename,
+  const char *fname,
+  const char *fcomment)
+{
+  int ret = 0;
+
+  // A BGZF file has an index that would need to be reopened as well.
+  if (kohnz->container == KOHNZ_CONTAINER_BGZF) { return -1; }
+
+  if (kohnz->out != NULL) { ret = close_file(kohnz); }
+
+  if (open_file(kohnz, filename) != 0) { return -1; }
+
+  write_header(kohnz, fname, fcomment);
+
+  return ret;
+}
+
+int kohnz_close(struct _kohnz *kohnz)
+{
+  int ret = 0;
+
+  if (kohnz->out != NULL) { ret = close_file(kohnz); }
+
+  // A file context's buffer is part of the same allocation unless it
+  // had to grow while a snapshot was held.
+  if (kohnz->buffer != (uint8_t *)(kohnz + 1))
+  {
+    kohnz_free(&kohnz->allocator, kohnz->buffer);
+  }
+
+  kohnz_free(&kohnz->allocator, kohnz->dynamic);
+  matcher_destroy(kohnz->matcher);
+  kohnz_free(&kohnz->allocator, kohnz->auto_block);
+  kohnz_free(&kohnz->allocator, kohnz->huffman_only);
+
+  kohnz_free(&kohnz->allocator, kohnz);
+
+  return ret;
+}
+
+int kohnz_start_uncompressed_block(struct _kohnz *kohnz)
+{
+  // BGZF contexts are only written with kohnz_write_bgzf(), which
+  // starts and ends its own blocks.
+  if (kohnz->container == KOHNZ_CONTAINER_BGZF) { return -1; }
+
+  // final=1, type=0 (stored), padded to a byte boundary.
+  write_bits(kohnz, 1, 1);
+  write_bits(kohnz, 0, 2);
+  write_bits_end_block(kohnz);
+
+  STATS_ADD(kohnz, blocks[0], 1);
+
+  kohnz->mode = MODE_UNCOMPRESSED;
+  kohnz->in_block = 1;
+  kohnz->is_final = 1;
+
+  TRACE3(block_start, kohnz->mode, 1, kohnz->file_size);
+
+  return 0;
+}
+
+int kohnz_start_fixed_block(struct _kohnz *kohnz, int is_final)
+{
+  if (kohnz->container == KOHNZ_CONTAINER_BGZF) { return -1; }
+
+  kohnz->mode = MODE_STATIC_HUFFMAN;
+  kohnz->in_block = 1;
+  kohnz->is_final = is_final == 0 ? 0 : 1;
+
+  // final=1 if this is the last block.
+  // type=1, fixed 
+  write_bits(kohnz, is_final == 0 ? 0 : 1, 1);
+  write_bits(kohnz, 1, 2);
+
+  STATS_ADD(kohnz, blocks[1], 1);
+  TRACE3(block_start, kohnz->mode, kohnz->is_final, kohnz->file_size);
+
+  return 0;
+}
+
+int kohnz_start_dynamic_block(
+  struct _kohnz *kohnz,
+  int is_final,
+  uint16_t *literals_sorted,
+  uint16_t *distances_sorted,
+  int literals_count,
+  int distances_count)
+{
+  if (kohnz->container == KOHNZ_CONTAINER_BGZF) { return -1; }
+
+  // The huffman tables are only allocated once a dynamic block is used.
+  if (kohnz->dynamic == NULL)
+  {
+    kohnz->dynamic = (struct _kohnz_table *)kohnz_alloc(
+      &kohnz->allocator,
+      sizeof(struct _kohnz_table));
+
+    if (kohnz->dynamic == NULL) { return -1; }
+  }
+
+  kohnz->mode = MODE_DYNAMIC_HUFFMAN;
+  kohnz->table = kohnz->dynamic;
+  kohnz->in_block = 1;
+  kohnz->is_final = is_final == 0 ? 0 : 1;
+
+  // final=1 if this is the last block.
+  // type=2, dynamic
+  write_bits(kohnz, is_final == 0 ? 0 : 1, 1);
+  write_bits(kohnz, 2, 2);
+
+  STATS_ADD(kohnz, blocks[2], 1);
+  TRACE3(block_start, kohnz->mode, kohnz->is_final, kohnz->file_size);
+
+  return dynamic_huffman_build(kohnz, literals_sorted, distances_sorted, literals_count, distances_count);
+}
+
+int kohnz_start_dynamic_block_table(
+  struct _kohnz *kohnz,
+  int is_final,
+  const struct _kohnz_table *table)
+{
+  if (kohnz->container == KOHNZ_CONTAINER_BGZF) { return -1; }
+
+  // The table isn't copied, so it has to stay around until the block
+  // is ended.
+  kohnz->mode = MODE_DYNAMIC_HUFFMAN;
+  kohnz->table = table;
+  kohnz->in_block = 1;
+  kohnz->is_final = is_final == 0 ? 0 : 1;
+
+  // final=1 if this is the last block.
+  // type=2, dynamic
+  write_bits(kohnz, is_final == 0 ? 0 : 1, 1);
+  write_bits(kohnz, 2, 2);
+
+  STATS_ADD(kohnz, blocks[2], 1);
+  TRACE3(block_start, kohnz->mode, kohnz->is_final, kohnz->file_size);
+
+  dynamic_huffman_write_header(kohnz, table);
+
+  return 0;
+}
+
+int kohnz_start_auto_block(struct _kohnz *kohnz, int is_final)
+{
+  if (kohnz->container == KOHNZ_CONTAINER_BGZF) { return -1; }
+
+  // Nothing is written yet.  The library picks where blocks start and
+  // end and what type each one is as the data comes in.
+  if (kohnz->auto_block == NULL)
+  {
+    kohnz->auto_block = auto_block_create(&kohnz->allocator);
+
+    if (kohnz->auto_block == NULL) { return -1; }
+  }
+
+  kohnz->mode = MODE_AUTO;
+  kohnz->in_block = 1;
+  kohnz->is_final = is_final == 0 ? 0 : 1;
+
+  TRACE3(block_start, kohnz->mode, kohnz->is_final, kohnz->file_size);
+
+  return 0;
+}
+
+int kohnz_start_huffman_block(struct _kohnz *kohnz, int is_final)
+{
+  if (kohnz->container == KOHNZ_CONTAINER_BGZF) { return -1; }
+
+  // Like an auto block nothing is written until there is enough data to
+  // build a table from.
+  if (kohnz->huffman_only == NULL)
+  {
+    kohnz->huffman_only = huffman_only_create(&kohnz->allocator);
+
+    if (kohnz->huffman_only == NULL) { return -1; }
+  }
+
+  kohnz->mode = MODE_HUFFMAN_ONLY;
+  kohnz->in_block = 1;
+  kohnz->is_final = is_final == 0 ? 0 : 1;
+
+  TRACE3(block_start, kohnz->mode, kohnz->is_final, kohnz->file_size);
+
+  return 0;
+}
+
+int kohnz_end_fixed_block(struct _kohnz *kohnz)
+{
+  // Write literal 256 and close block.  Only the final block is padded
+  // out to a byte, the next block starts on the following bit.
+  write_bits(kohnz, 0x00, 7);
+
+  if (kohnz->is_final != 0) { write_bits_end_block(kohnz); }
+
+  kohnz->in_block = 0;
+
+  TRACE2(block_end, kohnz->mode, kohnz->file_size);
+
+  return kohnz->error;
+}
+
+int kohnz_end_dynamic_block(struct _kohnz *kohnz)
+{
+  const struct _huffman *end_of_block = &kohnz->table->literals[256];
+
+  write_bits(kohnz, end_of_block->code, end_of_block->length);
+
+  if (kohnz->is_final != 0) { write_bits_end_block(kohnz); }
+
+  kohnz->in_block = 0;
+
+  TRACE2(block_end, kohnz->mode, kohnz->file_size);
+
+  return kohnz->error;
+}
+
+int kohnz_end_auto_block(struct _kohnz *kohnz)
+{
+  int ret;
+
+  kohnz->in_block = 0;
+
+  ret = auto_block_emit(kohnz, kohnz->is_final);
+
+  if (kohnz->error != 0) { ret = -1; }
+
+  TRACE2(block_end, kohnz->mode, kohnz->file_size);
+
+  return ret;
+}
+
+int kohnz_end_huffman_block(struct _kohnz *kohnz)
+{
+  int ret;
+
+  kohnz->in_block = 0;
+
+  ret = huffman_only_emit(kohnz, kohnz->is_final);
+
+  if (kohnz->error != 0) { ret = -1; }
+
+  TRACE2(block_end, kohnz->mode, kohnz->file_size);
+
+  return ret;
+}
+
+int kohnz_write_uncompressed(struct _kohnz *kohnz, const uint8_t *data, int length)
+{
+  write16(kohnz, length);
+  write16(kohnz, length ^ 0xffff);
+  write_data(kohnz, data, length);
+
+  STATS_ADD(kohnz, stored_bytes, length);
+
+  kohnz_build_crc32(kohnz, data, length);
+  kohnz->file_size += length;
+  kohnz->in_block = 0;
+
+  return kohnz->error;
+}
+
+int kohnz_write_fixed(struct _kohnz *kohnz, const uint8_t *data, int length)
+{
+  int code;
+  int n;
+  STATS_BEGIN(kohnz);
+
+  for (n = 0; n < length; n++)
+  {
+    if (*data <= 143)
+    {
+      code = deflate_reverse[*data + 0x30];
+      write_bits(kohnz, code, 8);
+    }
+    else if (*data <= 255)
+    {
+      code = (*data - 144) + 0x190;
+      code = (deflate_reverse[code & 0xff] << 1) | ((code >> 8) & 1);
+
+      write_bits(kohnz, code, 9);
+    }
+
+    data++;
+  }
+
+  STATS_ADD(kohnz, literals, length);
+  STATS_END(kohnz, literal_bits);
+
+  kohnz->file_size += length;
+
+  if (kohnz->flush_policy.type != KOHNZ_FLUSH_NONE)
+  {
+    check_flush_policy(kohnz);
+  }
+
+  return kohnz->error;
+}
+
+int kohnz_write_dynamic(struct _kohnz *kohnz, const uint8_t *data, int length)
+{
+  const struct _huffman *literals = kohnz->table->literals;
+  int n;
+  STATS_BEGIN(kohnz);
+
+  for (n = 0; n < length; n++)
+  {
+    const struct _huffman *literal = &literals[data[n]];
+
+    // A table built from a list of sorted symbols might not have a
+    // code for every byte.
+    if (literal->length == 0)
+    {
+      kohnz->file_size += n;
+      return -1;
+    }
+
+    write_bits(kohnz, literal->code, literal->length);
+  }
+
+  STATS_ADD(kohnz, literals, length);
+  STATS_END(kohnz, literal_bits);
+
+  kohnz->file_size += length;
+
+  if (kohnz->flush_policy.type != KOHNZ_FLUSH_NONE)
+  {
+    check_flush_policy(kohnz);
+  }
+
+  return kohnz->error;
+}
+
+int kohnz_write_auto(struct _kohnz *kohnz, const uint8_t *data, int length)
+{
+  auto_block_literals(kohnz, data, length);
+
+  kohnz->file_size += length;
+
+  if (kohnz->flush_policy.type != KOHNZ_FLUSH_NONE)
+  {
+    check_flush_policy(kohnz);
+  }
+
+  return kohnz->error;
+}
+
+int kohnz_write_huffman(struct _kohnz *kohnz, const uint8_t *data, int length)
+{
+  if (huffman_only_write(kohnz, data, length) != 0) { return -1; }
+
+  kohnz->file_size += length;
+
+  if (kohnz->flush_policy.type != KOHNZ_FLUSH_NONE)
+  {
+    check_flush_policy(kohnz);
+  }
+
+  return kohnz->error;
+}
+
+int kohnz_write_fixed_lz77(struct _kohnz *kohnz, int distance, int length)
+{
+  int code;
+  int extra_bits;
+  STATS_BEGIN(kohnz);
+
+  // Deflate distances are 1 to 32768, and can't reference data from
+  // before the start of the file or from before a full flush.
+  if (distance < 1 || distance > 32768) { return -2; }
+
+  if (distance > (int64_t)kohnz->file_size - kohnz->window_start)
+  {
+    return -2;
+  }
+
+  if (length < 3 || length > 258) { return -3; }
+
+  code = deflate_length_table[length].code;
+  extra_bits = deflate_length_table[length].extra_bits;
+
+#if 0
+printf("length=%d code=%d extra_bits=%d  %x\n",
+  length,
+  code,
+  extra_bits,
+  length - deflate_length_codes[code - 257]);
+#endif
+
+  if (code < 256)
+  {
+    return -3;
+  }
+  else if (code <= 279)
+  {
+    write_bits(kohnz, deflate_reverse[(code - 256) + 0x00] >> 1, 7);
+  }
+  else if (code <= 287)
+  {
+    write_bits(kohnz, deflate_reverse[(code - 280) + 0xc0], 8);
+  }
+
+  STATS_ADD(kohnz, match_lengths[code - 257], 1);
+
+  if (extra_bits != 0)
+  {
+    write_bits(kohnz, length - deflate_length_codes[code - 257], extra_bits);
+  }
+
+  code = deflate_distance_lookup(distance);
+  extra_bits = deflate_distance_extra_bits[code];
+
+#if 0
+printf("distance=%d code=%d extra_bits=%d  %x\n",
+  distance,
+  code,
+  extra_bits,
+  distance - deflate_distance_codes[code]);
+#endif
+
+  write_bits(kohnz, deflate_reverse[code] >> 3, 5);
+
+  STATS_ADD(kohnz, match_distances[code], 1);
+
+  if (extra_bits != 0)
+  {
+    //if (extra_bits <= 8)
+    {
+      write_bits(kohnz, distance - deflate_distance_codes[code], extra_bits);
+    }
+#if 0
+    else
+    {
+      int diff = distance - deflate_distance_codes[code];
+
+printf("code=%d distance=%d distance_code=%d diff=%d\n", code, distance, deflate_distance_codes[code], diff);
+      write_bits(kohnz, diff & 0xff, 8);
+      write_bits(kohnz, diff >> 8, extra_bits - 8);
+    }
+#endif
+  }
+
+  STATS_ADD(kohnz, matches, 1);
+  STATS_END(kohnz, match_bits);
+
+  kohnz->file_size += length;
+
+  if (kohnz->flush_policy.type != KOHNZ_FLUSH_NONE)
+  {
+    check_flush_policy(kohnz);
+  }
+
+  return kohnz->error;
+}
+
+int kohnz_write_dynamic_lz77(struct _kohnz *kohnz, int distance, int length)
+{
+  const struct _kohnz_table *table = kohnz->table;
+  const struct _huffman *huffman;
+  int code;
+  int extra_bits;
+  STATS_BEGIN(kohnz);
+
+  // Deflate distances are 1 to 32768, and can't reference data from
+  // before the start of the file or from before a full flush.
+  if (distance < 1 || distance > 32768) { return -2; }
+
+  if (distance > (int64_t)kohnz->file_size - kohnz->window_start)
+  {
+    return -2;
+  }
+
+  if (length < 3 || length > 258) { return -3; }
+
+  code = deflate_length_table[length].code;
+  extra_bits = deflate_length_table[length].extra_bits;
+
+  if (code < 257) { return -3; }
+
+  huffman = &table->literals[code];
+
+  if (huffman->length == 0) { return -1; }
+
+  write_bits(kohnz, huffman->code, huffman->length);
+
+  STATS_ADD(kohnz, match_lengths[code - 257], 1);
+
+  if (extra_bits != 0)
+  {
+    write_bits(kohnz, length - deflate_length_codes[code - 257], extra_bits);
+  }
+
+  code = deflate_distance_lookup(distance);
+  extra_bits = deflate_distance_extra_bits[code];
+
+  huffman = &table->distances[code];
+
+  if (huffman->length == 0) { return -1; }
+
+  write_bits(kohnz, huffman->code, huffman->length);
+
+  STATS_ADD(kohnz, match_distances[code], 1);
+
+  if (extra_bits != 0)
+  {
+    write_bits(kohnz, distance - deflate_distance_codes[code], extra_bits);
+  }
+
+  STATS_ADD(kohnz, matches, 1);
+  STATS_END(kohnz, match_bits);
+
+  kohnz->file_size += length;
+
+  if (kohnz->flush_policy.type != KOHNZ_FLUSH_NONE)
+  {
+    check_flush_policy(kohnz);
+  }
+
+  return kohnz->error;
+}
+
+int kohnz_write_auto_lz77(struct _kohnz *kohnz, int distance, int length)
+{
+  int ret;
+
+  // Deflate distances are 1 to 32768, and can't reference data from
+  // before the start of the file or from before a full flush.
+  if (distance < 1 || distance > 32768) { return -2; }
+
+  if (distance > (int64_t)kohnz->file_size - kohnz->window_start)
+  {
+    return -2;
+  }
+
+  ret = auto_block_match(kohnz, distance, length);
+
+  if (ret != 0) { return ret; }
+
+  kohnz->file_size += length;
+
+  if (kohnz->flush_policy.type != KOHNZ_FLUSH_NONE)
+  {
+    check_flush_policy(kohnz);
+  }
+
+  return kohnz->error;
+}
+
+int kohnz_cost_literals(struct _kohnz *kohnz, const uint8_t *data, int length)
+{
+  int cost = 0;
+  int n;
+
+  switch (kohnz->mode)
+  {
+    case MODE_UNCOMPRESSED:
+      return length * 8;
+    case MODE_DYNAMIC_HUFFMAN:
+    {
+      const struct _huffman *literals = kohnz->table->literals;
+
+      for (n = 0; n < length; n++)
+      {
+        if (literals[data[n]].length == 0) { return -1; }
+
+        cost += literals[data[n]].length;
+      }
+
+      return cost;
+    }
+    default:
+      // Auto and huffman only blocks don't have a table until the block
+      // is written, so the fixed codes are the best guess.
+      for (n = 0; n < length; n++)
+      {
+        cost += data[n] <= 143 ? 8 : 9;
+      }
+
+      return cost;
+  }
+}
+
+int kohnz_cost_lz77(struct _kohnz *kohnz, int distance, int length)
+{
+  int length_code, distance_code, extra_bits;
+
+  if (length < 3 || length > 258) { return -1; }
+  if (distance < 1 || distance > 32768) { return -1; }
+
+  if (distance > (int64_t)kohnz->file_size - kohnz->window_start)
+  {
+    return -2;
+  }
+
+  length_code = deflate_length_table[length].code;
+  distance_code = deflate_distance_lookup(distance);
+
+  extra_bits =
+    deflate_length_table[length].extra_bits +
+    deflate_distance_extra_bits[distance_code];
+
+  switch (kohnz->mode)
+  {
+    case MODE_STATIC_HUFFMAN:
+    case MODE_AUTO:
+      return (length_code <= 279 ? 7 : 8) + 5 + extra_bits;
+    case MODE_DYNAMIC_HUFFMAN:
+    {
+      const struct _kohnz_table *table = kohnz->table;
+
+      if (table->literals[length_code].length == 0) { return -1; }
+      if (table->distances[distance_code].length == 0) { return -1; }
+
+      return
+        table->literals[length_code].length +
+        table->distances[distance_code].length +
+        extra_bits;
+    }
+    default:
+      // There are no matches in stored or huffman only blocks.
+      return -1;
+  }
+}
+
+int kohnz_compress(struct _kohnz *kohnz, const uint8_t *data, int length)
+{
+  if (kohnz->container == KOHNZ_CONTAINER_BGZF) { return -1; }
+
+  if (kohnz->in_block == 0 || kohnz->mode == MODE_UNCOMPRESSED)
+  {
+    return -1;
+  }
+
+  // Huffman only skips the match finder completely.
+  if (kohnz->mode == MODE_HUFFMAN_ONLY)
+  {
+    if (kohnz_write_huffman(kohnz, data, length) != 0) { return -1; }
+
+    return kohnz_build_crc32(kohnz, data, length);
+  }
+
+  // The hash chains and window are only allocated the first time.
+  if (kohnz->matcher == NULL)
+  {
+    kohnz->matcher = matcher_create(&kohnz->allocator);
+
+    if (kohnz->matcher == NULL) { return -1; }
+  }
+
+  if (matcher_compress(kohnz, kohnz->matcher, data, length) != 0)
+  {
+    return -1;
+  }
+
+  kohnz_build_crc32(kohnz, data, length);
+
+  return kohnz->error;
+}
+
+int kohnz_set_level(struct _kohnz *kohnz, int level)
+{
+  if (level < KOHNZ_LEVEL_FAST || level > KOHNZ_LEVEL_OPTIMAL) { return -1; }
+
+  // Only read by kohnz_compress(), so this can change between blocks
+  // (or even between calls).
+  kohnz->level = level;
+
+  return 0;
 }
 
-struct _kohnz *kohnz_open(const char *filename, const char *fname, const char *fcomment)
+int kohnz_append(struct _kohnz *kohnz, struct _kohnz *segment)
 {
-  struct _kohnz *kohnz;
+  uint32_t crc32;
 
-  kohnz = (struct _kohnz *)malloc(sizeof(struct _kohnz));
+  // The segment is a series of complete, non-final blocks from a memory
+  // context.  It's spliced in at whatever bit the stream is at, so no
+  // padding.  A final block would have been padded to a byte already and
+  // those pad bits can't be told apart from data, so it's not allowed.
+  if (kohnz->in_block != 0 || kohnz->is_final != 0) { return -1; }
+  if (segment->is_memory == 0) { return -1; }
+  if (segment->in_block != 0 || segment->is_final != 0) { return -1; }
 
-  if (kohnz == NULL) { return NULL; }
+  // The segment has to have been keeping the same kind of checksum.
+  if (kohnz->container == KOHNZ_CONTAINER_ZLIB &&
+      segment->container != KOHNZ_CONTAINER_ZLIB)
+  {
+    return -1;
+  }
 
-  memset(kohnz, 0, sizeof(struct _kohnz));
+  if (write_bit_stream(
+    kohnz,
+    segment->buffer,
+    segment->buffer_length,
+    &segment->bits) != 0)
+  {
+    return -1;
+  }
 
-  kohnz->crc32 = 0xffffffff;
+  switch (kohnz->container)
+  {
+    case KOHNZ_CONTAINER_GZIP:
+    case KOHNZ_CONTAINER_BGZF:
+      crc32 = kohnz_crc32_combine(
+        kohnz->crc32 ^ 0xffffffff,
+        segment->crc32 ^ 0xffffffff,
+        segment->file_size);
 
-  kohnz->out = fopen(filename, "wb");
+      kohnz->crc32 = crc32 ^ 0xffffffff;
+      break;
+    case KOHNZ_CONTAINER_ZLIB:
+      kohnz->adler32 = kohnz_adler32_combine(
+        kohnz->adler32,
+        segment->adler32,
+        segment->file_size);
+      break;
+    default:
+      break;
+  }
 
-  if (kohnz == NULL)
+  kohnz->file_size += segment->file_size;
+
+  return 0;
+}
+
+int kohnz_set_dictionary(
+  struct _kohnz *kohnz,
+  const uint8_t *dictionary,
+  int length)
+{
+  uint32_t dictid;
+
+  // The dictionary has to be in place before any data is written.
+  if (kohnz->file_size != 0 || kohnz->in_block != 0 || kohnz->is_final != 0)
   {
-    free(kohnz);
-    return NULL;
+    return -1;
   }
 
-  uint8_t flags = 0;
+  if (kohnz->container == KOHNZ_CONTAINER_ZLIB)
+  {
+    // Only the 2 byte header can have been written, so it's still in the
+    // buffer and can be redone with FDICT set and the DICTID after it.
+    if (kohnz->buffer_length != 2 || kohnz->window_start != 0) { return -1; }
 
-  if (fname != NULL && fname[0] != 0) { flags |= 0x08; }
-  if (fcomment != NULL && fcomment[0] != 0) { flags |= 0x10; }
+    const uint8_t cmf = kohnz->buffer[0];
+    uint8_t flg = 0x20;
 
-  // Magic number
-  putc(0x1f, kohnz->out);
-  putc(0x8b, kohnz->out);
-  // Compression method 8 (DEFLATE)
-  putc(0x08, kohnz->out);
-  putc(flags, kohnz->out);
-  // Timestamp
-  write32(kohnz->out, 0);
-  // Compression flags
-  putc(0x02, kohnz->out);
-  // Operating system (3 is Unix)
-  putc(0x03, kohnz->out);
+    flg |= (31 - ((cmf << 8) | flg) % 31) % 31;
 
-  if (fname != NULL && fname[0] != 0)
+    kohnz->buffer[1] = flg;
+
+    dictid = kohnz_adler32(dictionary, length, 1);
+
+    write8(kohnz, dictid >> 24);
+    write8(kohnz, dictid >> 16);
+    write8(kohnz, dictid >> 8);
+    write8(kohnz, dictid);
+  }
+    else
+  if (kohnz->container != KOHNZ_CONTAINER_RAW && kohnz->is_memory == 0)
   {
-    fwrite(fname, 1, strlen(fname) + 1, kohnz->out);
+    // gzip has no way to tell the decompressor about a dictionary.
+    return -1;
   }
 
-  if (fcomment != NULL && fcomment[0] != 0)
+  // Only the last 32k of the dictionary can be referenced.
+  if (length > MATCHER_WINDOW)
   {
-    fwrite(fcomment, 1, strlen(fcomment) + 1, kohnz->out);
+    dictionary += length - MATCHER_WINDOW;
+    length = MATCHER_WINDOW;
   }
 
-  return kohnz;
-}
+  // lz77 distances are allowed to reach back into the dictionary.
+  kohnz->window_start = -length;
 
-int kohnz_close(struct _kohnz *kohnz)
-{
-  write32(kohnz->out, kohnz->crc32 ^ 0xffffffff);
-  write32(kohnz->out, kohnz->file_size);
+  if (kohnz->matcher == NULL)
+  {
+    kohnz->matcher = matcher_create(&kohnz->allocator);
 
-  fclose(kohnz->out);
+    if (kohnz->matcher == NULL) { return -1; }
+  }
 
-  free(kohnz);
+  matcher_prime(kohnz->matcher, dictionary, length, kohnz->file_size);
 
   return 0;
 }
 
-int kohnz_start_uncompressed_block(struct _kohnz *kohnz)
+int kohnz_write_bgzf(struct _kohnz *kohnz, const uint8_t *data, int length)
 {
-  putc(1, kohnz->out);
+  if (kohnz->container != KOHNZ_CONTAINER_BGZF) { return -1; }
 
-  return 0;
+  return bgzf_write(kohnz, data, length);
 }
 
-int kohnz_start_fixed_block(struct _kohnz *kohnz, int is_final)
+static int flush_stream(
+  struct _kohnz *kohnz,
+  int flush_type,
+  struct _kohnz_checkpoint *checkpoint)
 {
-  kohnz->bits.holding = 0;
-  kohnz->bits.length = 0;
+  TRACE_BEGIN(flush, start);
 
-  // final=1 if this is the last block.
-  // type=1, fixed 
-  write_bits(kohnz, is_final == 0 ? 0 : 1, 1);
-  write_bits(kohnz, 1, 2);
+  // A BGZF member can't be flushed early, kohnz_write_bgzf() decides
+  // where each one ends.
+  if (kohnz->container == KOHNZ_CONTAINER_BGZF) { return -1; }
+
+  if (kohnz->is_final != 0)
+  {
+    // Once the final block has started nothing can follow it.  If it's
+    // already closed everything is on a byte boundary anyway.
+    if (kohnz->in_block != 0) { return -1; }
+
+    return write_buffer_flush(kohnz);
+  }
+
+  if (kohnz->in_block != 0)
+  {
+    // End the current block with literal 256.  Auto and huffman only
+    // blocks write out everything they're holding as complete blocks.
+    switch (kohnz->mode)
+    {
+      case MODE_STATIC_HUFFMAN:
+        write_bits(kohnz, 0x00, 7);
+        break;
+      case MODE_DYNAMIC_HUFFMAN:
+        write_bits(
+          kohnz,
+          kohnz->table->literals[256].code,
+          kohnz->table->literals[256].length);
+        break;
+      case MODE_AUTO:
+        auto_block_emit(kohnz, 0);
+        break;
+      case MODE_HUFFMAN_ONLY:
+        if (huffman_only_emit(kohnz, 0) != 0) { return -1; }
+        break;
+      default:
+        return -1;
+    }
+  }
+
+  write_empty_stored_block(kohnz);
+
+  // The stored block leaves the stream on a byte boundary, and that's
+  // where a resumed stream starts (before the block is reopened).
+  if (checkpoint != NULL)
+  {
+    checkpoint->offset = (uint64_t)ftello(kohnz->out) + kohnz->buffer_length;
+    checkpoint->file_size = kohnz->file_size;
+    checkpoint->crc32 = kohnz->crc32;
+    checkpoint->adler32 = kohnz->adler32;
+    checkpoint->container = kohnz->container;
+    checkpoint->mode = kohnz->mode;
+    checkpoint->in_block = kohnz->in_block;
+  }
+
+  // Reopen a block of the same type so the caller can keep writing to
+  // it.  A dynamic block repeats the header for the same table.
+  if (kohnz->in_block != 0 && kohnz->mode == MODE_STATIC_HUFFMAN)
+  {
+    write_bits(kohnz, 0, 1);
+    write_bits(kohnz, 1, 2);
+    STATS_ADD(kohnz, blocks[1], 1);
+  }
+    else
+  if (kohnz->in_block != 0 && kohnz->mode == MODE_DYNAMIC_HUFFMAN)
+  {
+    write_bits(kohnz, 0, 1);
+    write_bits(kohnz, 2, 2);
+    STATS_ADD(kohnz, blocks[2], 1);
+    dynamic_huffman_write_header(kohnz, kohnz->table);
+  }
+
+  if (flush_type == KOHNZ_FLUSH_FULL)
+  {
+    kohnz->window_start = kohnz->file_size;
+  }
+
+  if (write_buffer_flush(kohnz) != 0) { return -1; }
+
+  STATS_ADD(kohnz, flush_count, 1);
+  TRACE3(flush, flush_type, kohnz->file_size, TRACE_ELAPSED(start));
+
+  kohnz->flush_policy.last_offset = kohnz->file_size;
+
+  if (kohnz->flush_policy.max_ns != 0)
+  {
+    kohnz->flush_policy.last_time = get_time_ns();
+  }
 
   return 0;
 }
 
-int kohnz_start_dynamic_block(
-  struct _kohnz *kohnz,
-  int is_final,
-  uint16_t *literals_sorted,
-  uint16_t *distances_sorted,
-  int literals_count,
-  int distances_count)
+int kohnz_flush(struct _kohnz *kohnz, int flush_type)
 {
-  kohnz->bits.holding = 0;
-  kohnz->bits.length = 0;
+  return flush_stream(kohnz, flush_type, NULL);
+}
 
-  // final=1 if this is the last block.
-  // type=2, dynamic
-  write_bits(kohnz, is_final == 0 ? 0 : 1, 1);
-  write_bits(kohnz, 2, 2);
+int kohnz_checkpoint(struct _kohnz *kohnz, struct _kohnz_checkpoint *checkpoint)
+{
+  // The file has to be something that can be truncated back to the
+  // checkpoint later, and a held snapshot could roll back past it.
+  if (kohnz->out == NULL || kohnz->container == KOHNZ_CONTAINER_BGZF)
+  {
+    return -1;
+  }
 
-  return dynamic_huffman_build(kohnz, literals_sorted, distances_sorted, literals_count, distances_count);
+  if (kohnz->is_final != 0 || kohnz->pinned != 0) { return -1; }
+  if (ftello(kohnz->out) < 0) { return -1; }
+
+  // A full flush means nothing after the checkpoint refers back to data
+  // before it, so the window doesn't need to be saved.
+  if (flush_stream(kohnz, KOHNZ_FLUSH_FULL, checkpoint) != 0) { return -1; }
+
+  // The checkpoint is only good once everything up to it is on disk.
+  if (fflush(kohnz->out) != 0 || fsync(fileno(kohnz->out)) != 0)
+  {
+    return -1;
+  }
+
+  return 0;
 }
 
-int kohnz_end_fixed_block(struct _kohnz *kohnz)
+static void put_uint32(uint8_t *blob, uint32_t value)
 {
-  // Write literal 256 and close block.
-  write_bits(kohnz, 0x00, 7);
-  write_bits_end_block(kohnz);
+  blob[0] = value & 0xff;
+  blob[1] = (value >> 8) & 0xff;
+  blob[2] = (value >> 16) & 0xff;
+  blob[3] = (value >> 24) & 0xff;
+}
 
-  return 0;
+static uint32_t get_uint32(const uint8_t *blob)
+{
+  return blob[0] | (blob[1] << 8) | (blob[2] << 16) | ((uint32_t)blob[3] << 24);
 }
 
-int kohnz_end_dynamic_block(struct _kohnz *kohnz)
+int kohnz_checkpoint_save(
+  const struct _kohnz_checkpoint *checkpoint,
+  uint8_t *blob,
+  int length)
 {
-  return -1;
+  if (blob == NULL) { return KOHNZ_CHECKPOINT_SIZE; }
+  if (length < KOHNZ_CHECKPOINT_SIZE) { return -1; }
+
+  // Little endian so it can be read back on another machine, with a CRC
+  // at the end to catch a checkpoint file that was only half written.
+  blob[0] = CHECKPOINT_MAGIC_0;
+  blob[1] = CHECKPOINT_MAGIC_1;
+  blob[2] = CHECKPOINT_VERSION;
+  blob[3] = checkpoint->container;
+  blob[4] = checkpoint->mode;
+  blob[5] = checkpoint->in_block;
+  blob[6] = 0;
+  blob[7] = 0;
+  put_uint32(blob + 8, checkpoint->offset & 0xffffffff);
+  put_uint32(blob + 12, checkpoint->offset >> 32);
+  put_uint32(blob + 16, checkpoint->file_size & 0xffffffff);
+  put_uint32(blob + 20, checkpoint->file_size >> 32);
+  put_uint32(blob + 24, checkpoint->crc32);
+  put_uint32(blob + 28, checkpoint->adler32);
+  put_uint32(blob + 32, kohnz_crc32(blob, 32, 0xffffffff));
+
+  return KOHNZ_CHECKPOINT_SIZE;
 }
 
-int kohnz_write_uncompressed(struct _kohnz *kohnz, const uint8_t *data, int length)
+int kohnz_checkpoint_load(
+  struct _kohnz_checkpoint *checkpoint,
+  const uint8_t *blob,
+  int length)
 {
-  write16(kohnz->out, length);
-  write16(kohnz->out, length ^ 0xffff);
-  fwrite(data, 1, length, kohnz->out);
+  if (length < KOHNZ_CHECKPOINT_SIZE) { return -1; }
 
-  kohnz->crc32 = kohnz_crc32(data, length, kohnz->crc32);
-  kohnz->file_size += length;
+  if (blob[0] != CHECKPOINT_MAGIC_0 ||
+      blob[1] != CHECKPOINT_MAGIC_1 ||
+      blob[2] != CHECKPOINT_VERSION)
+  {
+    return -1;
+  }
+
+  if (get_uint32(blob + 32) != kohnz_crc32(blob, 32, 0xffffffff)) { return -1; }
+
+  checkpoint->container = blob[3];
+  checkpoint->mode = blob[4];
+  checkpoint->in_block = blob[5];
+  checkpoint->offset =
+    get_uint32(blob + 8) | ((uint64_t)get_uint32(blob + 12) << 32);
+  checkpoint->file_size =
+    get_uint32(blob + 16) | ((uint64_t)get_uint32(blob + 20) << 32);
+  checkpoint->crc32 = get_uint32(blob + 24);
+  checkpoint->adler32 = get_uint32(blob + 28);
 
   return 0;
 }
 
-int kohnz_write_fixed(struct _kohnz *kohnz, const uint8_t *data, int length)
+struct _kohnz *kohnz_resume(
+  const char *filename,
+  const struct _kohnz_checkpoint *checkpoint)
 {
-  int code;
-  int n;
+  struct _kohnz *kohnz;
+  off_t length;
 
-  for (n = 0; n < length; n++)
+  if (checkpoint->container != KOHNZ_CONTAINER_GZIP &&
+      checkpoint->container != KOHNZ_CONTAINER_ZLIB &&
+      checkpoint->container != KOHNZ_CONTAINER_RAW)
   {
-    if (*data <= 143)
-    {
-      code = deflate_reverse[*data + 0x30];
-      write_bits(kohnz, code, 8);
-    }
-    else if (*data <= 255)
-    {
-      code = (*data - 144) + 0x190;
-      code = (deflate_reverse[code & 0xff] << 1) | ((code >> 8) & 1);
+    return NULL;
+  }
 
-      write_bits(kohnz, code, 9);
-    }
+  kohnz = alloc_context(NULL, KOHNZ_BUFFER_SIZE);
 
-    data++;
+  if (kohnz == NULL) { return NULL; }
+
+  kohnz->buffer = (uint8_t *)(kohnz + 1);
+  kohnz->buffer_size = KOHNZ_BUFFER_SIZE;
+  kohnz->container = checkpoint->container;
+
+  reset_state(kohnz);
+
+  kohnz->out = fopen(filename, "r+b");
+
+  if (kohnz->out == NULL)
+  {
+    kohnz_free(&kohnz->allocator, kohnz);
+    return NULL;
   }
 
-  kohnz->file_size += length;
+  setvbuf(kohnz->out, NULL, _IONBF, 0);
 
-  return 0;
+  // Anything written after the checkpoint is thrown away.  A file that
+  // is shorter than the checkpoint lost data the checkpoint covers.
+  length = fseeko(kohnz->out, 0, SEEK_END) == 0 ? ftello(kohnz->out) : -1;
+
+  if (length < 0 ||
+      (uint64_t)length < checkpoint->offset ||
+      ftruncate(fileno(kohnz->out), checkpoint->offset) != 0 ||
+      fseeko(kohnz->out, checkpoint->offset, SEEK_SET) != 0)
+  {
+    fclose(kohnz->out);
+    kohnz_free(&kohnz->allocator, kohnz);
+    return NULL;
+  }
+
+  // The checkpoint was a full flush, so the window starts here.
+  kohnz->file_size = checkpoint->file_size;
+  kohnz->crc32 = checkpoint->crc32;
+  kohnz->adler32 = checkpoint->adler32;
+  kohnz->window_start = checkpoint->file_size;
+  kohnz->flush_policy.last_offset = checkpoint->file_size;
+
+  return kohnz;
 }
 
-int kohnz_write_dynamic(struct _kohnz *kohnz, const uint8_t *data, int length)
+int kohnz_set_flush_policy(
+  struct _kohnz *kohnz,
+  int flush_type,
+  int max_ms,
+  uint32_t max_bytes)
 {
-  return -1;
+  struct _flush_policy *flush_policy = &kohnz->flush_policy;
+
+  if (flush_type != KOHNZ_FLUSH_NONE &&
+      flush_type != KOHNZ_FLUSH_SYNC &&
+      flush_type != KOHNZ_FLUSH_FULL)
+  {
+    return -1;
+  }
+
+  flush_policy->type = flush_type;
+  flush_policy->max_bytes = max_bytes;
+  flush_policy->max_ns = (uint64_t)max_ms * 1000000;
+  flush_policy->last_time = get_time_ns();
+  flush_policy->last_offset = kohnz->file_size;
+
+  return 0;
 }
 
-int kohnz_write_fixed_lz77(struct _kohnz *kohnz, int distance, int length)
+int kohnz_snapshot_take(struct _kohnz *kohnz, struct _kohnz_snapshot *snapshot)
 {
-  int code;
-  int extra_bits;
+  // Auto and huffman only blocks are holding data that isn't in the
+  // buffer yet, and BGZF writes members through a second context.
+  if (kohnz->in_block != 0 &&
+     (kohnz->mode == MODE_AUTO || kohnz->mode == MODE_HUFFMAN_ONLY))
+  {
+    return -1;
+  }
 
-  code = deflate_length_table[length].code;
-  extra_bits = deflate_length_table[length].extra_bits;
+  if (kohnz->container == KOHNZ_CONTAINER_BGZF) { return -1; }
 
-#if 0
-printf("length=%d code=%d extra_bits=%d  %x\n",
-  length,
-  code,
-  extra_bits,
-  length - deflate_length_codes[code - 257]);
+  snapshot->buffer_length = kohnz->buffer_length;
+  snapshot->bits = kohnz->bits;
+  snapshot->file_size = kohnz->file_size;
+  snapshot->crc32 = kohnz->crc32;
+  snapshot->adler32 = kohnz->adler32;
+  snapshot->window_start = kohnz->window_start;
+  snapshot->mode = kohnz->mode;
+  snapshot->in_block = kohnz->in_block;
+  snapshot->is_final = kohnz->is_final;
+  snapshot->table = kohnz->table;
+
+#ifdef KOHNZ_STATS
+  snapshot->stats = kohnz->stats;
 #endif
 
-  if (code < 256)
+  if (kohnz->matcher != NULL)
   {
-    return -3;
+    snapshot->matcher_pos = kohnz->matcher->pos;
+    snapshot->matcher_end = kohnz->matcher->end;
+    snapshot->matcher_hash_pos = kohnz->matcher->hash_pos;
+    snapshot->matcher_slides = kohnz->matcher->slides;
+    snapshot->matcher_file_size = kohnz->matcher->file_size;
   }
-  else if (code <= 279)
+    else
   {
-    write_bits(kohnz, deflate_reverse[(code - 256) + 0x00] >> 1, 7);
+    snapshot->matcher_slides = -1;
   }
-  else if (code <= 287)
+
+  kohnz->pinned++;
+
+  return 0;
+}
+
+int kohnz_snapshot_restore(struct _kohnz *kohnz, const struct _kohnz_snapshot *snapshot)
+{
+  if (kohnz->pinned == 0) { return -1; }
+
+  if (kohnz->in_block != 0 &&
+     (kohnz->mode == MODE_AUTO || kohnz->mode == MODE_HUFFMAN_ONLY))
   {
-    write_bits(kohnz, deflate_reverse[(code - 280) + 0xc0], 8);
+    return -1;
   }
 
-  if (extra_bits != 0)
+  // The match finder can go back to where it was as long as its window
+  // hasn't slid since.  Otherwise its history can't be trusted and it
+  // starts over.
+  if (kohnz->matcher != NULL)
   {
-    write_bits(kohnz, length - deflate_length_codes[code - 257], extra_bits);
+    if (kohnz->matcher->slides == snapshot->matcher_slides)
+    {
+      matcher_rollback(
+        kohnz->matcher,
+        snapshot->matcher_pos,
+        snapshot->matcher_end,
+        snapshot->matcher_hash_pos,
+        snapshot->matcher_file_size);
+    }
+      else
+    {
+      matcher_reset(kohnz->matcher);
+    }
   }
 
-  code = deflate_distance_table[distance - 1].code;
-  extra_bits = deflate_distance_table[distance - 1].extra_bits;
+  kohnz->buffer_length = snapshot->buffer_length;
+  kohnz->bits = snapshot->bits;
+  kohnz->file_size = snapshot->file_size;
+  kohnz->crc32 = snapshot->crc32;
+  kohnz->adler32 = snapshot->adler32;
+  kohnz->window_start = snapshot->window_start;
+  kohnz->mode = snapshot->mode;
+  kohnz->in_block = snapshot->in_block;
+  kohnz->is_final = snapshot->is_final;
+  kohnz->table = snapshot->table;
 
-#if 0
-printf("distance=%d code=%d extra_bits=%d  %x\n",
-  distance,
-  code,
-  extra_bits,
-  distance - deflate_distance_codes[code]);
+#ifdef KOHNZ_STATS
+  // Counters for output that was thrown away go back too, so the bit
+  // position the counters are based on matches the buffer again.  Time
+  // spent encoding it was still spent though.
+  {
+    const uint64_t crc_cycles = kohnz->stats.crc_cycles;
+    const uint64_t encode_cycles = kohnz->stats.encode_cycles;
+
+    kohnz->stats = snapshot->stats;
+    kohnz->stats.crc_cycles = crc_cycles;
+    kohnz->stats.encode_cycles = encode_cycles;
+  }
 #endif
 
-  write_bits(kohnz, deflate_reverse[code] >> 3, 5);
+  return 0;
+}
 
-  if (extra_bits != 0)
+void kohnz_snapshot_release(struct _kohnz *kohnz, struct _kohnz_snapshot *snapshot)
+{
+  if (kohnz->pinned == 0) { return; }
+
+  kohnz->pinned--;
+
+  // Anything that piled up while the output was pinned can go out now.
+  if (kohnz->pinned == 0 && kohnz->buffer_length >= KOHNZ_BUFFER_SIZE)
   {
-    //if (extra_bits <= 8)
-    {
-      write_bits(kohnz, distance - deflate_distance_codes[code], extra_bits);
-    }
-#if 0
-    else
-    {
-      int diff = distance - deflate_distance_codes[code];
+    write_buffer_flush(kohnz);
+  }
+}
 
-printf("code=%d distance=%d distance_code=%d diff=%d\n", code, distance, deflate_distance_codes[code], diff);
-      write_bits(kohnz, diff & 0xff, 8);
-      write_bits(kohnz, diff >> 8, extra_bits - 8);
-    }
-#endif
+uint64_t kohnz_snapshot_bits(
+  struct _kohnz *kohnz,
+  const struct _kohnz_snapshot *snapshot)
+{
+  return
+    (uint64_t)(kohnz->buffer_length - snapshot->buffer_length) * 8 +
+    kohnz->bits.length - snapshot->bits.length;
+}
+
+int kohnz_set_max_code_length(struct _kohnz *kohnz, int max_code_length)
+{
+  // 286 literal / length codes need at least 9 bits.
+  if (max_code_length < DYNAMIC_MIN_LIMIT || max_code_length > DYNAMIC_MAX_BITS)
+  {
+    return -1;
   }
 
-  kohnz->file_size += length;
+  kohnz->max_code_length = max_code_length;
 
   return 0;
 }
 
-int kohnz_write_dynamic_lz77(struct _kohnz *kohnz, int distance, int length)
+uint64_t kohnz_get_code_length_cost(struct _kohnz *kohnz)
 {
+  return kohnz->code_length_cost;
+}
+
+int kohnz_get_stats(struct _kohnz *kohnz, struct _kohnz_stats *stats)
+{
+#ifdef KOHNZ_STATS
+  memcpy(stats, &kohnz->stats, sizeof(struct _kohnz_stats));
+
+  return 0;
+#else
+  memset(stats, 0, sizeof(struct _kohnz_stats));
+
   return -1;
+#endif
+}
+
+void kohnz_clear_stats(struct _kohnz *kohnz)
+{
+#ifdef KOHNZ_STATS
+  memset(&kohnz->stats, 0, sizeof(struct _kohnz_stats));
+#endif
 }
 
 int kohnz_build_crc32(struct _kohnz *kohnz, const uint8_t *data, int length)
 {
-  kohnz->crc32 = kohnz_crc32(data, length, kohnz->crc32);
+#ifdef KOHNZ_STATS
+  const uint64_t start_cycles = STATS_CYCLES();
+#endif
+
+  // Only the checksum the container needs is computed.  Memory contexts
+  // use CRC32 unless their container is changed to match the stream
+  // they'll be appended to.
+  switch (kohnz->container)
+  {
+    case KOHNZ_CONTAINER_GZIP:
+    case KOHNZ_CONTAINER_BGZF:
+      kohnz->crc32 = kohnz_crc32(data, length, kohnz->crc32);
+      break;
+    case KOHNZ_CONTAINER_ZLIB:
+      kohnz->adler32 = kohnz_adler32(data, length, kohnz->adler32);
+      break;
+    default:
+      break;
+  }
+
+  STATS_ADD(kohnz, crc_cycles, STATS_CYCLES() - start_cycles);
 
   return 0;
 }
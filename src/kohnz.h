@@ -15,9 +15,30 @@
 #include <stdio.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define MODE_UNCOMPRESSED 0
-#define MODE_STATIC HUFFMAN 1
-#define MODE_DYNAMIC HUFFMAN 2
+#define MODE_STATIC_HUFFMAN 1
+#define MODE_DYNAMIC_HUFFMAN 2
+#define MODE_AUTO 3
+#define MODE_HUFFMAN_ONLY 4
+
+#define KOHNZ_BUFFER_SIZE 4096
+
+#define KOHNZ_CONTAINER_GZIP 0
+#define KOHNZ_CONTAINER_BGZF 1
+#define KOHNZ_CONTAINER_ZLIB 2
+#define KOHNZ_CONTAINER_RAW 3
+
+#define KOHNZ_FLUSH_NONE 0
+#define KOHNZ_FLUSH_SYNC 1
+#define KOHNZ_FLUSH_FULL 2
+
+#define KOHNZ_LEVEL_FAST 0
+#define KOHNZ_LEVEL_LAZY 1
+#define KOHNZ_LEVEL_OPTIMAL 2
 
 struct _huffman
 {
@@ -31,24 +52,202 @@ struct _bits
   int length;
 };
 
+struct _flush_policy
+{
+  int type;
+  uint32_t max_bytes;
+  uint64_t max_ns;
+  uint64_t last_time;
+  uint64_t last_offset;
+};
+
+// How a context allocates memory.  It's copied from whatever
+// kohnz_set_allocator() last installed when the context is opened.
+struct _kohnz_allocator
+{
+  void *(*alloc)(size_t size, void *context);
+  void (*free)(void *ptr, void *context);
+  void *context;
+};
+
+#define KOHNZ_TABLE_HEADER_MAX 320
+
+struct _kohnz_histogram
+{
+  uint32_t literals[286];
+  uint32_t distances[30];
+};
+
+// Huffman codes for a dynamic block along with the block header that
+// describes them, already encoded so it can be copied into the stream.
+struct _kohnz_table
+{
+  int literals_length;
+  int distances_length;
+  struct _huffman literals[286];
+  struct _huffman distances[30];
+  int header_length;
+  struct _bits header_tail;
+  uint8_t header[KOHNZ_TABLE_HEADER_MAX];
+};
+
+struct _kohnz_stats
+{
+  uint64_t literals;
+  uint64_t matches;
+  uint64_t match_lengths[29];
+  uint64_t match_distances[30];
+  uint64_t stored_bytes;
+  uint64_t literal_bits;
+  uint64_t match_bits;
+  uint64_t header_bits;
+  uint64_t blocks[3];
+  uint64_t bytes_flushed;
+  uint64_t flush_count;
+  uint64_t crc_cycles;
+  uint64_t encode_cycles;
+};
+
+struct _kohnz_snapshot
+{
+  int buffer_length;
+  struct _bits bits;
+  uint64_t file_size;
+  uint32_t crc32;
+  uint32_t adler32;
+  int64_t window_start;
+  int mode;
+  int in_block;
+  int is_final;
+  const struct _kohnz_table *table;
+  int matcher_pos;
+  int matcher_end;
+  int matcher_hash_pos;
+  int matcher_slides;
+  uint64_t matcher_file_size;
+#ifdef KOHNZ_STATS
+  struct _kohnz_stats stats;
+#endif
+};
+
+#define KOHNZ_CHECKPOINT_SIZE 36
+
+// Where a stream can be picked up again after the program restarts.
+// offset is the length of the compressed file at the checkpoint and
+// file_size is how much uncompressed data that holds.
+struct _kohnz_checkpoint
+{
+  uint64_t offset;
+  uint64_t file_size;
+  uint32_t crc32;
+  uint32_t adler32;
+  int container;
+  int mode;
+  int in_block;
+};
+
+struct _kohnz_shared;
+struct _matcher;
+struct _bgzf;
+struct _auto_block;
+struct _huffman_only;
+
 struct _kohnz
 {
-  FILE *out;
+  // Touched on every write, kept together at the start of the struct.
+  uint8_t *buffer;
+  int buffer_length;
+  int buffer_size;
   struct _bits bits;
   uint64_t file_size;
   uint32_t crc32;
+  uint32_t adler32;
   int mode;
-  int len;
-  int literals_length;
-  int distances_length;
-  struct _huffman literals[286];
-  struct _huffman distances[32];
-  uint8_t data[65536];
+  int in_block;
+  int is_final;
+  const struct _kohnz_table *table;
+  int64_t window_start;
+  struct _flush_policy flush_policy;
+
+  // Output file, or NULL when the output is kept in memory.
+  FILE *out;
+  int is_memory;
+  int container;
+
+  // Number of snapshots being held.  The buffer grows instead of being
+  // written out while this isn't 0.
+  int pinned;
+
+  // Set to -1 once writing the output has failed.  Nothing more is
+  // stored after that and the write, end block and close calls return it.
+  int error;
+
+  // Longest huffman code dynamic blocks can use and how many bits that
+  // has cost compared to allowing 15.
+  int max_code_length;
+  uint64_t code_length_cost;
+
+  // How hard kohnz_compress() looks for matches (KOHNZ_LEVEL_*).
+  int level;
+
+  struct _kohnz_allocator allocator;
+
+  // Only allocated when a dynamic huffman block is started from a list
+  // of sorted symbols.
+  struct _kohnz_table *dynamic;
+
+  // Only allocated when kohnz_compress() is used.
+  struct _matcher *matcher;
+
+  // Only allocated for BGZF output.
+  struct _bgzf *bgzf;
+
+  // Only allocated when an auto block is started.
+  struct _auto_block *auto_block;
+
+  // Only allocated when a huffman only block is started.
+  struct _huffman_only *huffman_only;
+
+#ifdef KOHNZ_STATS
+  // Kept last so the rest of the struct is the same either way.
+  struct _kohnz_stats stats;
+#endif
 };
 
 void kohnz_init();
 struct _kohnz *kohnz_open(const char *filename, const char *fname, const char *fcomment);
+
+struct _kohnz *kohnz_open_container(
+  const char *filename,
+  int container,
+  const char *fname,
+  const char *fcomment);
+
+struct _kohnz *kohnz_open_bgzf(const char *filename, const char *index_filename);
+
+struct _kohnz *kohnz_open_file(
+  FILE *out,
+  int container,
+  const char *fname,
+  const char *fcomment);
+
+struct _kohnz *kohnz_open_memory();
+int kohnz_reset(struct _kohnz *kohnz);
+uint8_t *kohnz_get_memory(struct _kohnz *kohnz, int *length);
+
+int kohnz_reopen(
+  struct _kohnz *kohnz,
+  const char *filename,
+  const char *fname,
+  const char *fcomment);
+
 int kohnz_close(struct _kohnz *kohnz);
+
+void kohnz_set_allocator(
+  void *(*alloc)(size_t size, void *context),
+  void (*free)(void *ptr, void *context),
+  void *context);
+
 int kohnz_start_uncompressed_block(struct _kohnz *kohnz);
 int kohnz_start_fixed_block(struct _kohnz *kohnz, int is_final);
 
@@ -60,15 +259,123 @@ int kohnz_start_dynamic_block(
   int literals_count,
   int distances_count);
 
+int kohnz_start_dynamic_block_table(
+  struct _kohnz *kohnz,
+  int is_final,
+  const struct _kohnz_table *table);
+
+int kohnz_start_auto_block(struct _kohnz *kohnz, int is_final);
+int kohnz_start_huffman_block(struct _kohnz *kohnz, int is_final);
 int kohnz_end_fixed_block(struct _kohnz *kohnz);
 int kohnz_end_dynamic_block(struct _kohnz *kohnz);
+int kohnz_end_auto_block(struct _kohnz *kohnz);
+int kohnz_end_huffman_block(struct _kohnz *kohnz);
 int kohnz_write_uncompressed(struct _kohnz *kohnz, const uint8_t *data, int length);
 int kohnz_write_fixed(struct _kohnz *kohnz, const uint8_t *data, int length);
 int kohnz_write_dynamic(struct _kohnz *kohnz, const uint8_t *data, int length);
+int kohnz_write_auto(struct _kohnz *kohnz, const uint8_t *data, int length);
+int kohnz_write_huffman(struct _kohnz *kohnz, const uint8_t *data, int length);
 int kohnz_write_fixed_lz77(struct _kohnz *kohnz, int distance, int length);
 int kohnz_write_dynamic_lz77(struct _kohnz *kohnz, int distance, int length);
+int kohnz_write_auto_lz77(struct _kohnz *kohnz, int distance, int length);
+int kohnz_cost_literals(struct _kohnz *kohnz, const uint8_t *data, int length);
+int kohnz_cost_lz77(struct _kohnz *kohnz, int distance, int length);
+int kohnz_compress(struct _kohnz *kohnz, const uint8_t *data, int length);
+int kohnz_set_level(struct _kohnz *kohnz, int level);
+
+int kohnz_compress_parallel(
+  struct _kohnz *kohnz,
+  const uint8_t *data,
+  uint64_t length,
+  int threads,
+  int chunk_size);
+
+int kohnz_set_dictionary(
+  struct _kohnz *kohnz,
+  const uint8_t *dictionary,
+  int length);
+
+int kohnz_write_bgzf(struct _kohnz *kohnz, const uint8_t *data, int length);
+int kohnz_append(struct _kohnz *kohnz, struct _kohnz *segment);
+int kohnz_flush(struct _kohnz *kohnz, int flush_type);
+int kohnz_checkpoint(struct _kohnz *kohnz, struct _kohnz_checkpoint *checkpoint);
+
+int kohnz_checkpoint_save(
+  const struct _kohnz_checkpoint *checkpoint,
+  uint8_t *blob,
+  int length);
+
+int kohnz_checkpoint_load(
+  struct _kohnz_checkpoint *checkpoint,
+  const uint8_t *blob,
+  int length);
+
+struct _kohnz *kohnz_resume(
+  const char *filename,
+  const struct _kohnz_checkpoint *checkpoint);
+
+int kohnz_set_flush_policy(
+  struct _kohnz *kohnz,
+  int flush_type,
+  int max_ms,
+  uint32_t max_bytes);
+
+struct _kohnz_shared *kohnz_shared_open(
+  const char *filename,
+  const char *fname,
+  const char *fcomment,
+  int slot_count);
+
+int kohnz_shared_commit(struct _kohnz_shared *shared, struct _kohnz *record);
+int kohnz_shared_close(struct _kohnz_shared *shared);
+void kohnz_histogram_init(struct _kohnz_histogram *histogram);
+
+void kohnz_histogram_add_literals(
+  struct _kohnz_histogram *histogram,
+  const uint8_t *data,
+  int length);
+
+int kohnz_histogram_add_match(
+  struct _kohnz_histogram *histogram,
+  int distance,
+  int length);
+
+int kohnz_histogram_add_sample(
+  struct _kohnz_histogram *histogram,
+  const uint8_t *data,
+  int length);
+
+int kohnz_table_build(
+  struct _kohnz_table *table,
+  const struct _kohnz_histogram *histogram);
+
+int kohnz_table_build_limited(
+  struct _kohnz_table *table,
+  const struct _kohnz_histogram *histogram,
+  int max_code_length,
+  uint64_t *cost);
+
+int kohnz_table_save(const struct _kohnz_table *table, uint8_t *blob, int length);
+int kohnz_table_load(struct _kohnz_table *table, const uint8_t *blob, int length);
+
+int kohnz_snapshot_take(struct _kohnz *kohnz, struct _kohnz_snapshot *snapshot);
+int kohnz_snapshot_restore(struct _kohnz *kohnz, const struct _kohnz_snapshot *snapshot);
+void kohnz_snapshot_release(struct _kohnz *kohnz, struct _kohnz_snapshot *snapshot);
+
+uint64_t kohnz_snapshot_bits(
+  struct _kohnz *kohnz,
+  const struct _kohnz_snapshot *snapshot);
+
+int kohnz_get_stats(struct _kohnz *kohnz, struct _kohnz_stats *stats);
+void kohnz_clear_stats(struct _kohnz *kohnz);
+int kohnz_set_max_code_length(struct _kohnz *kohnz, int max_code_length);
+uint64_t kohnz_get_code_length_cost(struct _kohnz *kohnz);
 int kohnz_build_crc32(struct _kohnz *kohnz, const uint8_t *data, int length);
 uint64_t kohnz_get_offset(struct _kohnz *kohnz);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
 
@@ -0,0 +1,425 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ */
+
+#ifndef _KOHNZ_HPP
+#define _KOHNZ_HPP
+
+// C++17 wrapper around the C API.  Nothing here needs to be compiled
+// into the library.  An encoder owns a struct _kohnz and closes it when
+// it goes out of scope.  Blocks are types with the block mode as a
+// template parameter, so picking write_fixed() or write_dynamic() (and
+// whether the wrapper counts anything) is done by the compiler instead
+// of being checked on every call.
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#define KOHNZ_HAS_SPAN
+#endif
+
+#include "kohnz.h"
+
+namespace kohnz
+{
+
+enum class mode
+{
+  fixed = MODE_STATIC_HUFFMAN,
+  dynamic = MODE_DYNAMIC_HUFFMAN,
+  automatic = MODE_AUTO,
+  huffman_only = MODE_HUFFMAN_ONLY,
+};
+
+enum class level
+{
+  fast = KOHNZ_LEVEL_FAST,
+  lazy = KOHNZ_LEVEL_LAZY,
+  optimal = KOHNZ_LEVEL_OPTIMAL,
+};
+
+enum class container
+{
+  gzip = KOHNZ_CONTAINER_GZIP,
+  zlib = KOHNZ_CONTAINER_ZLIB,
+  raw = KOHNZ_CONTAINER_RAW,
+};
+
+class error : public std::runtime_error
+{
+public:
+  explicit error(const char *message) : std::runtime_error(message) { }
+};
+
+// What the wrapper counted for one block (only when the block's stats
+// parameter is true).
+struct block_stats
+{
+  uint64_t literals = 0;
+  uint64_t matches = 0;
+  uint64_t bytes = 0;
+};
+
+template<mode M, bool Stats>
+class block;
+
+class encoder
+{
+public:
+  encoder() = default;
+
+  explicit encoder(struct _kohnz *kohnz) : kohnz_(kohnz)
+  {
+    if (kohnz_ == nullptr) { throw error("kohnz: couldn't open"); }
+  }
+
+  static encoder open(
+    const char *filename,
+    container type = container::gzip,
+    const char *fname = nullptr,
+    const char *fcomment = nullptr)
+  {
+    return encoder(
+      kohnz_open_container(filename, static_cast<int>(type), fname, fcomment));
+  }
+
+  static encoder open_bgzf(const char *filename, const char *index = nullptr)
+  {
+    return encoder(kohnz_open_bgzf(filename, index));
+  }
+
+  static encoder open_memory()
+  {
+    return encoder(kohnz_open_memory());
+  }
+
+  static encoder resume(
+    const char *filename,
+    const struct _kohnz_checkpoint &checkpoint)
+  {
+    return encoder(kohnz_resume(filename, &checkpoint));
+  }
+
+  encoder(const encoder &) = delete;
+  encoder &operator=(const encoder &) = delete;
+
+  encoder(encoder &&other) noexcept : kohnz_(other.release()) { }
+
+  encoder &operator=(encoder &&other) noexcept
+  {
+    if (this != &other)
+    {
+      reset();
+      kohnz_ = other.release();
+    }
+
+    return *this;
+  }
+
+  // A destructor can't report errors, so call close() to find out if
+  // the file was written.
+  ~encoder() { reset(); }
+
+  int close()
+  {
+    int ret = 0;
+
+    if (kohnz_ != nullptr) { ret = kohnz_close(kohnz_); }
+
+    kohnz_ = nullptr;
+
+    return ret;
+  }
+
+  struct _kohnz *get() const { return kohnz_; }
+
+  struct _kohnz *release()
+  {
+    struct _kohnz *kohnz = kohnz_;
+
+    kohnz_ = nullptr;
+
+    return kohnz;
+  }
+
+  explicit operator bool() const { return kohnz_ != nullptr; }
+
+  template<mode M, bool Stats = false>
+  block<M, Stats> start(bool is_final = false)
+  {
+    return block<M, Stats>(kohnz_, is_final);
+  }
+
+  template<mode M, bool Stats = false>
+  block<M, Stats> start(const struct _kohnz_table &table, bool is_final = false)
+  {
+    static_assert(M == mode::dynamic, "Only dynamic blocks take a table");
+
+    return block<M, Stats>(kohnz_, table, is_final);
+  }
+
+  // Read by compress(), so it can be changed between blocks.
+  int set_level(level value)
+  {
+    return kohnz_set_level(kohnz_, static_cast<int>(value));
+  }
+
+  int flush(int flush_type = KOHNZ_FLUSH_SYNC)
+  {
+    return kohnz_flush(kohnz_, flush_type);
+  }
+
+  int checkpoint(struct _kohnz_checkpoint &checkpoint)
+  {
+    return kohnz_checkpoint(kohnz_, &checkpoint);
+  }
+
+  int write_bgzf(const uint8_t *data, std::size_t length)
+  {
+    return kohnz_write_bgzf(kohnz_, data, static_cast<int>(length));
+  }
+
+  int write_bgzf(std::string_view text)
+  {
+    return write_bgzf(reinterpret_cast<const uint8_t *>(text.data()), text.size());
+  }
+
+  uint64_t offset() const { return kohnz_get_offset(kohnz_); }
+
+  std::string_view memory() const
+  {
+    int length;
+    uint8_t *data = kohnz_get_memory(kohnz_, &length);
+
+    return std::string_view(reinterpret_cast<const char *>(data), length);
+  }
+
+private:
+  void reset()
+  {
+    if (kohnz_ != nullptr) { kohnz_close(kohnz_); }
+
+    kohnz_ = nullptr;
+  }
+
+  struct _kohnz *kohnz_ = nullptr;
+};
+
+template<mode M, bool Stats = false>
+class block
+{
+public:
+  block(struct _kohnz *kohnz, bool is_final) : kohnz_(kohnz)
+  {
+    int ret = -1;
+
+    if constexpr (M == mode::fixed)
+    {
+      ret = kohnz_start_fixed_block(kohnz_, is_final);
+    }
+      else
+    if constexpr (M == mode::automatic)
+    {
+      ret = kohnz_start_auto_block(kohnz_, is_final);
+    }
+      else
+    if constexpr (M == mode::huffman_only)
+    {
+      ret = kohnz_start_huffman_block(kohnz_, is_final);
+    }
+      else
+    {
+      static_assert(M != mode::dynamic, "Dynamic blocks need a table");
+    }
+
+    if (ret != 0) { throw error("kohnz: couldn't start block"); }
+  }
+
+  block(struct _kohnz *kohnz, const struct _kohnz_table &table, bool is_final) :
+    kohnz_(kohnz)
+  {
+    if (kohnz_start_dynamic_block_table(kohnz_, is_final, &table) != 0)
+    {
+      throw error("kohnz: couldn't start block");
+    }
+  }
+
+  block(const block &) = delete;
+  block &operator=(const block &) = delete;
+
+  block(block &&other) noexcept :
+    kohnz_(std::exchange(other.kohnz_, nullptr)),
+    stats_(other.stats_)
+  {
+  }
+
+  block &operator=(block &&) = delete;
+
+  ~block() { end(); }
+
+  // Writes literals, and like kohnz_compress() they go into the
+  // checksum too.
+  int write(const uint8_t *data, std::size_t length)
+  {
+    const int count = static_cast<int>(length);
+    int ret;
+
+    if constexpr (M == mode::fixed)
+    {
+      ret = kohnz_write_fixed(kohnz_, data, count);
+    }
+      else
+    if constexpr (M == mode::dynamic)
+    {
+      ret = kohnz_write_dynamic(kohnz_, data, count);
+    }
+      else
+    if constexpr (M == mode::automatic)
+    {
+      ret = kohnz_write_auto(kohnz_, data, count);
+    }
+      else
+    {
+      ret = kohnz_write_huffman(kohnz_, data, count);
+    }
+
+    if (ret != 0) { return ret; }
+
+    if constexpr (Stats)
+    {
+      stats_.literals += length;
+      stats_.bytes += length;
+    }
+
+    return kohnz_build_crc32(kohnz_, data, count);
+  }
+
+  int write(std::string_view text)
+  {
+    return write(reinterpret_cast<const uint8_t *>(text.data()), text.size());
+  }
+
+#ifdef KOHNZ_HAS_SPAN
+  int write(std::span<const uint8_t> data)
+  {
+    return write(data.data(), data.size());
+  }
+#endif
+
+  // An lz77 reference.  The checksum has to be updated by the caller
+  // with the bytes it copies (see kohnz_build_crc32()).
+  int lz77(int distance, int length)
+  {
+    static_assert(M != mode::huffman_only, "Huffman only blocks have no lz77");
+
+    int ret;
+
+    if constexpr (M == mode::fixed)
+    {
+      ret = kohnz_write_fixed_lz77(kohnz_, distance, length);
+    }
+      else
+    if constexpr (M == mode::dynamic)
+    {
+      ret = kohnz_write_dynamic_lz77(kohnz_, distance, length);
+    }
+      else
+    {
+      ret = kohnz_write_auto_lz77(kohnz_, distance, length);
+    }
+
+    if constexpr (Stats)
+    {
+      if (ret == 0)
+      {
+        stats_.matches++;
+        stats_.bytes += length;
+      }
+    }
+
+    return ret;
+  }
+
+  // Uses the library's match finder.
+  int compress(const uint8_t *data, std::size_t length)
+  {
+    const int ret = kohnz_compress(kohnz_, data, static_cast<int>(length));
+
+    if constexpr (Stats)
+    {
+      if (ret == 0) { stats_.bytes += length; }
+    }
+
+    return ret;
+  }
+
+  int compress(std::string_view text)
+  {
+    return compress(reinterpret_cast<const uint8_t *>(text.data()), text.size());
+  }
+
+#ifdef KOHNZ_HAS_SPAN
+  int compress(std::span<const uint8_t> data)
+  {
+    return compress(data.data(), data.size());
+  }
+#endif
+
+  int end()
+  {
+    int ret = 0;
+
+    if (kohnz_ == nullptr) { return 0; }
+
+    if constexpr (M == mode::fixed)
+    {
+      ret = kohnz_end_fixed_block(kohnz_);
+    }
+      else
+    if constexpr (M == mode::dynamic)
+    {
+      ret = kohnz_end_dynamic_block(kohnz_);
+    }
+      else
+    if constexpr (M == mode::automatic)
+    {
+      ret = kohnz_end_auto_block(kohnz_);
+    }
+      else
+    {
+      ret = kohnz_end_huffman_block(kohnz_);
+    }
+
+    kohnz_ = nullptr;
+
+    return ret;
+  }
+
+  const block_stats &stats() const
+  {
+    static_assert(Stats, "Stats weren't turned on for this block");
+
+    return stats_;
+  }
+
+private:
+  struct _kohnz *kohnz_;
+  block_stats stats_;
+};
+
+}
+
+#endif
+
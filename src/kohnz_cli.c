@@ -0,0 +1,561 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "kohnz.h"
+
+// Command line compressor.  Regular files are mmap'ed, anything else
+// (stdin, pipes) is read in chunks.
+
+#define CHUNK_SIZE (1 << 20)
+#define PARALLEL_READ_SIZE (1 << 24)
+
+struct _options
+{
+  const char *input;
+  const char *output;
+  int to_stdout;
+  int force;
+  int mode;
+  int mode_set;
+  int container;
+  int level;
+  int level_set;
+  int threads;
+  int verbose;
+};
+
+struct _compressor
+{
+  struct _kohnz *kohnz;
+  struct _kohnz_table table;
+  const struct _options *options;
+  uint64_t length;
+};
+
+static uint64_t get_time_ns()
+{
+  struct timespec tp;
+
+  clock_gettime(CLOCK_MONOTONIC, &tp);
+
+  return (uint64_t)tp.tv_sec * 1000000000 + tp.tv_nsec;
+}
+
+static void usage(const char *name)
+{
+  printf("Usage: %s [options] [input]\n"
+         "  -c             write to stdout\n"
+         "  -o <file>      output file (default is input with .gz / .zz / .deflate)\n"
+         "  -m <mode>      auto, dynamic, fixed, huffman (default auto)\n"
+         "  -f             overwrite the output file if it exists\n"
+         "  -F <format>    gzip, zlib, raw, bgzf (default gzip)\n"
+         "  -l <level>     fast, lazy, optimal (default fast)\n"
+         "  -t <threads>   compress chunks on threads (fixed blocks, 0=all cpus)\n"
+         "-t and bgzf only write fixed blocks, and huffman doesn't use -l.\n"
+         "  -v             print sizes and speed to stderr\n"
+         "With no input (or -) stdin is compressed to stdout.\n",
+    name);
+}
+
+static int parse_options(struct _options *options, int argc, char *argv[])
+{
+  int n;
+
+  memset(options, 0, sizeof(struct _options));
+
+  options->mode = MODE_AUTO;
+  options->container = KOHNZ_CONTAINER_GZIP;
+  options->threads = 1;
+
+  for (n = 1; n < argc; n++)
+  {
+    const char *arg = argv[n];
+    const char *value = n + 1 < argc ? argv[n + 1] : NULL;
+
+    if (strcmp(arg, "-c") == 0)
+    {
+      options->to_stdout = 1;
+      continue;
+    }
+      else
+    if (strcmp(arg, "-f") == 0)
+    {
+      options->force = 1;
+      continue;
+    }
+      else
+    if (strcmp(arg, "-v") == 0)
+    {
+      options->verbose = 1;
+      continue;
+    }
+      else
+    if (arg[0] != '-' || strcmp(arg, "-") == 0)
+    {
+      if (options->input != NULL) { return -1; }
+      options->input = arg;
+      continue;
+    }
+
+    if (value == NULL) { return -1; }
+
+    n++;
+
+    if (strcmp(arg, "-o") == 0)
+    {
+      options->output = value;
+    }
+      else
+    if (strcmp(arg, "-t") == 0)
+    {
+      options->threads = atoi(value);
+    }
+      else
+    if (strcmp(arg, "-m") == 0)
+    {
+      if (strcmp(value, "auto") == 0) { options->mode = MODE_AUTO; }
+      else if (strcmp(value, "dynamic") == 0) { options->mode = MODE_DYNAMIC_HUFFMAN; }
+      else if (strcmp(value, "fixed") == 0) { options->mode = MODE_STATIC_HUFFMAN; }
+      else if (strcmp(value, "huffman") == 0) { options->mode = MODE_HUFFMAN_ONLY; }
+      else { return -1; }
+
+      options->mode_set = 1;
+    }
+      else
+    if (strcmp(arg, "-F") == 0)
+    {
+      if (strcmp(value, "gzip") == 0) { options->container = KOHNZ_CONTAINER_GZIP; }
+      else if (strcmp(value, "zlib") == 0) { options->container = KOHNZ_CONTAINER_ZLIB; }
+      else if (strcmp(value, "raw") == 0) { options->container = KOHNZ_CONTAINER_RAW; }
+      else if (strcmp(value, "bgzf") == 0) { options->container = KOHNZ_CONTAINER_BGZF; }
+      else { return -1; }
+    }
+      else
+    if (strcmp(arg, "-l") == 0)
+    {
+      if (strcmp(value, "fast") == 0) { options->level = KOHNZ_LEVEL_FAST; }
+      else if (strcmp(value, "lazy") == 0) { options->level = KOHNZ_LEVEL_LAZY; }
+      else if (strcmp(value, "optimal") == 0) { options->level = KOHNZ_LEVEL_OPTIMAL; }
+      else { return -1; }
+
+      options->level_set = 1;
+    }
+      else
+    {
+      return -1;
+    }
+  }
+
+  // Threads and BGZF write their own fixed blocks, and huffman only
+  // blocks never search for matches.  Options that would be ignored are
+  // an error instead.
+  if (options->container == KOHNZ_CONTAINER_BGZF && options->threads != 1)
+  {
+    fprintf(stderr, "Error: -t can't be used with bgzf\n");
+    return -1;
+  }
+
+  if (options->mode_set == 1 &&
+      options->mode != MODE_STATIC_HUFFMAN &&
+      (options->container == KOHNZ_CONTAINER_BGZF || options->threads != 1))
+  {
+    fprintf(stderr, "Error: -t and bgzf only write fixed blocks\n");
+    return -1;
+  }
+
+  if (options->level_set == 1 && options->mode == MODE_HUFFMAN_ONLY)
+  {
+    fprintf(stderr, "Error: -l can't be used with huffman\n");
+    return -1;
+  }
+
+  if (options->input != NULL && strcmp(options->input, "-") == 0)
+  {
+    options->input = NULL;
+  }
+
+  // Reading from stdin means writing to stdout unless told otherwise.
+  if (options->input == NULL && options->output == NULL)
+  {
+    options->to_stdout = 1;
+  }
+
+  return 0;
+}
+
+static const char *get_basename(const char *filename)
+{
+  const char *s = strrchr(filename, '/');
+
+  return s == NULL ? filename : s + 1;
+}
+
+static int start_blocks(struct _compressor *compressor)
+{
+  struct _kohnz *kohnz = compressor->kohnz;
+
+  // Threads and BGZF write complete blocks themselves, and dynamic
+  // blocks get a new table for every chunk.  Otherwise one block is
+  // left open the whole time.
+  if (compressor->options->container == KOHNZ_CONTAINER_BGZF) { return 0; }
+  if (compressor->options->threads != 1) { return 0; }
+
+  switch (compressor->options->mode)
+  {
+    case MODE_AUTO: return kohnz_start_auto_block(kohnz, 0);
+    case MODE_STATIC_HUFFMAN: return kohnz_start_fixed_block(kohnz, 0);
+    case MODE_HUFFMAN_ONLY: return kohnz_start_huffman_block(kohnz, 0);
+    default: return 0;
+  }
+}
+
+static int end_blocks(struct _compressor *compressor)
+{
+  struct _kohnz *kohnz = compressor->kohnz;
+
+  if (compressor->options->container == KOHNZ_CONTAINER_BGZF) { return 0; }
+  if (compressor->options->threads != 1) { return 0; }
+
+  // kohnz_close() ends the stream with an empty final block.
+  switch (compressor->options->mode)
+  {
+    case MODE_AUTO: return kohnz_end_auto_block(kohnz);
+    case MODE_STATIC_HUFFMAN: return kohnz_end_fixed_block(kohnz);
+    case MODE_HUFFMAN_ONLY: return kohnz_end_huffman_block(kohnz);
+    default: return 0;
+  }
+}
+
+static int compress_dynamic(
+  struct _compressor *compressor,
+  const uint8_t *data,
+  int length)
+{
+  struct _kohnz *kohnz = compressor->kohnz;
+  struct _kohnz_histogram histogram;
+
+  // Each chunk gets a table built from its own symbol counts.
+  kohnz_histogram_init(&histogram);
+
+  if (kohnz_histogram_add_sample(&histogram, data, length) != 0) { return -1; }
+  if (kohnz_table_build(&compressor->table, &histogram) != 0) { return -1; }
+
+  if (kohnz_start_dynamic_block_table(kohnz, 0, &compressor->table) != 0)
+  {
+    return -1;
+  }
+
+  if (kohnz_compress(kohnz, data, length) != 0) { return -1; }
+
+  return kohnz_end_dynamic_block(kohnz);
+}
+
+static int compress_data(
+  struct _compressor *compressor,
+  const uint8_t *data,
+  uint64_t length)
+{
+  const struct _options *options = compressor->options;
+  struct _kohnz *kohnz = compressor->kohnz;
+
+  compressor->length += length;
+
+  if (options->container == KOHNZ_CONTAINER_BGZF)
+  {
+    while (length > 0)
+    {
+      const int count = length > CHUNK_SIZE ? CHUNK_SIZE : length;
+
+      if (kohnz_write_bgzf(kohnz, data, count) != 0) { return -1; }
+
+      data += count;
+      length -= count;
+    }
+
+    return 0;
+  }
+
+  if (options->threads != 1)
+  {
+    return kohnz_compress_parallel(kohnz, data, length, options->threads, 0);
+  }
+
+  while (length > 0)
+  {
+    const int count = length > CHUNK_SIZE ? CHUNK_SIZE : length;
+
+    if (options->mode == MODE_DYNAMIC_HUFFMAN)
+    {
+      if (compress_dynamic(compressor, data, count) != 0) { return -1; }
+    }
+      else
+    {
+      if (kohnz_compress(kohnz, data, count) != 0) { return -1; }
+    }
+
+    data += count;
+    length -= count;
+  }
+
+  return 0;
+}
+
+static int compress_mmap(struct _compressor *compressor, int fd, uint64_t length)
+{
+  uint8_t *data;
+  int ret;
+
+  data = (uint8_t *)mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  if (data == MAP_FAILED) { return -1; }
+
+  madvise(data, length, MADV_SEQUENTIAL);
+
+  ret = compress_data(compressor, data, length);
+
+  munmap(data, length);
+
+  return ret;
+}
+
+static int compress_stream(struct _compressor *compressor, int fd)
+{
+  uint8_t *buffer;
+  int buffer_size;
+  int length;
+  int count;
+  int ret = 0;
+
+  // Threads need a lot of data at once to have anything to split up.
+  buffer_size =
+    compressor->options->threads != 1 ? PARALLEL_READ_SIZE : CHUNK_SIZE;
+
+  buffer = (uint8_t *)malloc(buffer_size);
+
+  if (buffer == NULL) { return -1; }
+
+  while (1)
+  {
+    length = 0;
+
+    while (length < buffer_size)
+    {
+      count = read(fd, buffer + length, buffer_size - length);
+
+      if (count <= 0) { break; }
+
+      length += count;
+    }
+
+    if (count < 0) { ret = -1; break; }
+    if (length == 0) { break; }
+
+    if (compress_data(compressor, buffer, length) != 0) { ret = -1; break; }
+
+    if (count == 0) { break; }
+  }
+
+  free(buffer);
+
+  return ret;
+}
+
+static FILE *open_output(const char *filename, int force)
+{
+  FILE *out;
+  int fd;
+
+  // Like gzip, a file that's already there is only replaced with -f.
+  fd = open(
+    filename,
+    O_WRONLY | O_CREAT | (force == 1 ? O_TRUNC : O_EXCL),
+    0644);
+
+  if (fd < 0) { return NULL; }
+
+  out = fdopen(fd, "wb");
+
+  if (out == NULL) { close(fd); }
+
+  return out;
+}
+
+int main(int argc, char *argv[])
+{
+  struct _options options;
+  struct _compressor compressor;
+  struct stat stat_buffer;
+  FILE *out;
+  char *output = NULL;
+  const char *fname = NULL;
+  uint64_t start;
+  int fd = 0;
+  int ret;
+
+  if (parse_options(&options, argc, argv) != 0)
+  {
+    usage(argv[0]);
+    exit(1);
+  }
+
+  if (options.input != NULL)
+  {
+    fd = open(options.input, O_RDONLY);
+
+    if (fd < 0)
+    {
+      fprintf(stderr, "Error: Couldn't open %s\n", options.input);
+      exit(1);
+    }
+
+    fname = get_basename(options.input);
+  }
+
+  if (options.to_stdout == 1)
+  {
+    if (isatty(1))
+    {
+      fprintf(stderr, "Error: Not writing compressed data to a terminal.\n");
+      exit(1);
+    }
+
+    // Written through fd 1 so a redirect to a file isn't truncated and
+    // no /dev/stdout is needed.
+    out = fdopen(1, "wb");
+
+    if (out == NULL)
+    {
+      fprintf(stderr, "Error: Couldn't write to stdout\n");
+      exit(1);
+    }
+  }
+    else
+  {
+    if (options.output != NULL)
+    {
+      output = strdup(options.output);
+    }
+      else
+    {
+      const char *extension =
+        options.container == KOHNZ_CONTAINER_ZLIB ? ".zz" :
+        options.container == KOHNZ_CONTAINER_RAW ? ".deflate" : ".gz";
+
+      output = (char *)malloc(strlen(options.input) + strlen(extension) + 1);
+
+      if (output != NULL)
+      {
+        sprintf(output, "%s%s", options.input, extension);
+      }
+    }
+
+    if (output == NULL) { exit(1); }
+
+    out = open_output(output, options.force);
+
+    if (out == NULL)
+    {
+      if (errno == EEXIST)
+      {
+        fprintf(stderr, "Error: %s already exists (use -f to overwrite)\n",
+          output);
+      }
+        else
+      {
+        fprintf(stderr, "Error: Couldn't open %s for writing\n", output);
+      }
+
+      exit(1);
+    }
+  }
+
+  memset(&compressor, 0, sizeof(compressor));
+  compressor.options = &options;
+
+  compressor.kohnz = kohnz_open_file(out, options.container, fname, NULL);
+
+  if (compressor.kohnz == NULL)
+  {
+    fprintf(stderr, "Error: Couldn't start compressing to %s\n",
+      output == NULL ? "stdout" : output);
+    fclose(out);
+    exit(1);
+  }
+
+  kohnz_set_level(compressor.kohnz, options.level);
+
+  start = get_time_ns();
+
+  ret = start_blocks(&compressor);
+
+  if (ret == 0)
+  {
+    if (fstat(fd, &stat_buffer) == 0 &&
+        S_ISREG(stat_buffer.st_mode) &&
+        stat_buffer.st_size > 0)
+    {
+      ret = compress_mmap(&compressor, fd, stat_buffer.st_size);
+    }
+      else
+    {
+      ret = compress_stream(&compressor, fd);
+    }
+  }
+
+  if (ret == 0) { ret = end_blocks(&compressor); }
+
+  if (kohnz_close(compressor.kohnz) != 0) { ret = -1; }
+
+  if (ret != 0)
+  {
+    fprintf(stderr, "Error: Compressing %s failed\n",
+      options.input == NULL ? "stdin" : options.input);
+
+    // Don't leave a partial file behind that stops the next run.
+    if (options.to_stdout == 0) { unlink(output); }
+  }
+    else
+  if (options.verbose == 1)
+  {
+    const double seconds = (double)(get_time_ns() - start) / 1000000000;
+
+    if (options.to_stdout == 0 && stat(output, &stat_buffer) == 0)
+    {
+      fprintf(stderr, "%s: %lu -> %lu (%.1f%%) ",
+        output,
+        (unsigned long)compressor.length,
+        (unsigned long)stat_buffer.st_size,
+        compressor.length == 0 ? 0 :
+          100.0 * stat_buffer.st_size / compressor.length);
+    }
+
+    fprintf(stderr, "%.1f MB/s\n",
+      ((double)compressor.length / (1024 * 1024)) / seconds);
+  }
+
+  if (fd != 0) { close(fd); }
+
+  free(output);
+
+  return ret == 0 ? 0 : 1;
+}
+
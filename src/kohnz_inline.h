@@ -0,0 +1,198 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ */
+
+#ifndef _KOHNZ_INLINE_H
+#define _KOHNZ_INLINE_H
+
+#include <stdint.h>
+
+#include "kohnz.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "deflate_codes.h"
+
+// Inline versions of the bit writer and the fixed huffman writers so a
+// program that writes lots of small records doesn't make a call into
+// the library for every one.  They write the same bits as the library
+// functions.  When there isn't room in the buffer for everything the
+// call needs, the library function is called instead (which can write
+// the buffer out to the file).  These don't update stats counters.
+
+int kohnz_buffer_reserve(struct _kohnz *kohnz, int length);
+void kohnz_check_flush_policy(struct _kohnz *kohnz);
+
+static inline void kohnz_write_bits_inline(
+  struct _kohnz *kohnz,
+  uint32_t data,
+  int length)
+{
+  struct _bits *bits = &kohnz->bits;
+
+  bits->holding |= data << bits->length;
+  bits->length += length;
+
+  while (bits->length >= 8)
+  {
+    if (kohnz->buffer_length == kohnz->buffer_size &&
+        kohnz_buffer_reserve(kohnz, 1) != 0)
+    {
+      // The output has failed (kohnz->error is set), so drop the bits.
+      bits->holding = 0;
+      bits->length = 0;
+      return;
+    }
+
+    kohnz->buffer[kohnz->buffer_length++] = bits->holding & 0xff;
+
+    bits->holding >>= 8;
+    bits->length -= 8;
+  }
+}
+
+// Only for when the caller already knows there's room in the buffer.
+static inline void kohnz_write_bits_unchecked(
+  struct _kohnz *kohnz,
+  uint32_t data,
+  int length)
+{
+  struct _bits *bits = &kohnz->bits;
+  uint8_t *buffer = kohnz->buffer + kohnz->buffer_length;
+  uint32_t holding = bits->holding | (data << bits->length);
+  int count = bits->length + length;
+
+  while (count >= 8)
+  {
+    *buffer++ = holding & 0xff;
+    holding >>= 8;
+    count -= 8;
+  }
+
+  kohnz->buffer_length = buffer - kohnz->buffer;
+  bits->holding = holding;
+  bits->length = count;
+}
+
+static inline void kohnz_fixed_literal_unchecked(struct _kohnz *kohnz, uint8_t data)
+{
+  int code;
+
+  if (data <= 143)
+  {
+    kohnz_write_bits_unchecked(kohnz, deflate_reverse[data + 0x30], 8);
+  }
+    else
+  {
+    code = (data - 144) + 0x190;
+    code = (deflate_reverse[code & 0xff] << 1) | ((code >> 8) & 1);
+
+    kohnz_write_bits_unchecked(kohnz, code, 9);
+  }
+}
+
+static inline int kohnz_write_fixed_inline(
+  struct _kohnz *kohnz,
+  const uint8_t *data,
+  int length)
+{
+  int n;
+
+  // Each literal is at most 9 bits.
+  if (kohnz->buffer_size - kohnz->buffer_length < length + (length >> 3) + 2)
+  {
+    return kohnz_write_fixed(kohnz, data, length);
+  }
+
+  for (n = 0; n < length; n++)
+  {
+    kohnz_fixed_literal_unchecked(kohnz, data[n]);
+  }
+
+  kohnz->file_size += length;
+
+  if (kohnz->flush_policy.type != KOHNZ_FLUSH_NONE)
+  {
+    kohnz_check_flush_policy(kohnz);
+  }
+
+  return kohnz->error;
+}
+
+static inline int kohnz_write_fixed_lz77_inline(
+  struct _kohnz *kohnz,
+  int distance,
+  int length)
+{
+  int code;
+  int extra_bits;
+
+  // A length and distance is at most 31 bits, so 5 bytes.  Anything out
+  // of range goes through the library function, which checks it and
+  // returns the error.
+  if (kohnz->buffer_size - kohnz->buffer_length < 8 ||
+      length < 3 || length > 258 ||
+      distance < 1 || distance > 32768 ||
+      distance > (int64_t)kohnz->file_size - kohnz->window_start)
+  {
+    return kohnz_write_fixed_lz77(kohnz, distance, length);
+  }
+
+  code = deflate_length_table[length].code;
+  extra_bits = deflate_length_table[length].extra_bits;
+
+  if (code <= 279)
+  {
+    kohnz_write_bits_unchecked(kohnz, deflate_reverse[code - 256] >> 1, 7);
+  }
+    else
+  {
+    kohnz_write_bits_unchecked(kohnz, deflate_reverse[(code - 280) + 0xc0], 8);
+  }
+
+  if (extra_bits != 0)
+  {
+    kohnz_write_bits_unchecked(
+      kohnz,
+      length - deflate_length_codes[code - 257],
+      extra_bits);
+  }
+
+  code = deflate_distance_lookup(distance);
+  extra_bits = deflate_distance_extra_bits[code];
+
+  kohnz_write_bits_unchecked(kohnz, deflate_reverse[code] >> 3, 5);
+
+  if (extra_bits != 0)
+  {
+    kohnz_write_bits_unchecked(
+      kohnz,
+      distance - deflate_distance_codes[code],
+      extra_bits);
+  }
+
+  kohnz->file_size += length;
+
+  if (kohnz->flush_policy.type != KOHNZ_FLUSH_NONE)
+  {
+    kohnz_check_flush_policy(kohnz);
+  }
+
+  return kohnz->error;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
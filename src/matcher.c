@@ -0,0 +1,799 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "deflate_codes.h"
+#include "kohnz.h"
+#include "matcher.h"
+
+#define WINDOW_MASK (MATCHER_WINDOW - 1)
+
+// A 3 byte match further back than this costs more than the literals.
+#define TOO_FAR 4096
+
+// The optimal parse works on this many bytes at a time and keeps up to
+// OPTIMAL_MATCHES matches of increasing length for each position.
+#define OPTIMAL_SIZE 8192
+#define OPTIMAL_MATCHES 8
+#define OPTIMAL_INFINITE 0xffffffff
+
+struct _level
+{
+  int max_chain;
+  int nice_length;
+};
+
+static const struct _level levels[] =
+{
+  { 32, 128 },    // KOHNZ_LEVEL_FAST
+  { 128, 128 },   // KOHNZ_LEVEL_LAZY
+  { 256, 258 },  // KOHNZ_LEVEL_OPTIMAL
+};
+
+struct _match
+{
+  uint16_t length;
+  uint16_t distance;
+};
+
+struct _optimal
+{
+  // Bits each symbol costs with the codes the block will be written with.
+  uint32_t literal_cost[256];
+  uint32_t length_cost[MATCHER_MAX_LENGTH + 1];
+  uint32_t distance_cost[30];
+
+  // cost[n] is the cheapest way found to encode the first n bytes and
+  // step[n] / distance[n] is the last literal (step 1) or match of it.
+  uint32_t cost[OPTIMAL_SIZE + 1];
+  uint16_t step[OPTIMAL_SIZE + 1];
+  uint16_t distance[OPTIMAL_SIZE + 1];
+  uint16_t path[OPTIMAL_SIZE + 1];
+  int path_length;
+
+  uint8_t count[OPTIMAL_SIZE];
+  struct _match matches[OPTIMAL_SIZE][OPTIMAL_MATCHES];
+
+  struct _kohnz_histogram histogram;
+  struct _kohnz_table table;
+};
+
+static inline uint32_t hash3(const uint8_t *data)
+{
+  const uint32_t value = (data[0] << 16) | (data[1] << 8) | data[2];
+
+  return (value * 2654435761u) >> (32 - MATCHER_HASH_BITS);
+}
+
+static inline int insert_hash(struct _matcher *matcher, int pos)
+{
+  const uint32_t hash = hash3(matcher->window + pos);
+  const int chain = matcher->head[hash];
+
+  matcher->prev[pos & WINDOW_MASK] = chain;
+  matcher->head[hash] = pos;
+
+  return chain;
+}
+
+static void slide(struct _matcher *matcher)
+{
+  int n;
+
+  memcpy(matcher->window, matcher->window + MATCHER_WINDOW, MATCHER_WINDOW);
+
+  matcher->slides++;
+
+  matcher->pos -= MATCHER_WINDOW;
+  matcher->end -= MATCHER_WINDOW;
+  matcher->hash_pos -= MATCHER_WINDOW;
+
+  for (n = 0; n < MATCHER_HASH_SIZE; n++)
+  {
+    const int pos = matcher->head[n];
+    matcher->head[n] = pos >= MATCHER_WINDOW ? pos - MATCHER_WINDOW : 0;
+  }
+
+  for (n = 0; n < MATCHER_WINDOW; n++)
+  {
+    const int pos = matcher->prev[n];
+    matcher->prev[n] = pos >= MATCHER_WINDOW ? pos - MATCHER_WINDOW : 0;
+  }
+}
+
+static int emit_literals(
+  struct _kohnz *kohnz,
+  struct _matcher *matcher,
+  const uint8_t *data,
+  int length)
+{
+  if (length == 0) { return 0; }
+
+  if (matcher->histogram != NULL)
+  {
+    // Only counting symbols, but the offsets still have to move so
+    // matches can reach back over what was already seen.
+    kohnz_histogram_add_literals(matcher->histogram, data, length);
+    kohnz->file_size += length;
+    return 0;
+  }
+
+  if (kohnz->mode == MODE_DYNAMIC_HUFFMAN)
+  {
+    return kohnz_write_dynamic(kohnz, data, length);
+  }
+    else
+  if (kohnz->mode == MODE_AUTO)
+  {
+    return kohnz_write_auto(kohnz, data, length);
+  }
+
+  return kohnz_write_fixed(kohnz, data, length);
+}
+
+static int emit_match(
+  struct _kohnz *kohnz,
+  struct _matcher *matcher,
+  int distance,
+  int length)
+{
+  if (matcher->histogram != NULL)
+  {
+    kohnz->file_size += length;
+    return kohnz_histogram_add_match(matcher->histogram, distance, length);
+  }
+
+  if (kohnz->mode == MODE_DYNAMIC_HUFFMAN)
+  {
+    return kohnz_write_dynamic_lz77(kohnz, distance, length);
+  }
+    else
+  if (kohnz->mode == MODE_AUTO)
+  {
+    return kohnz_write_auto_lz77(kohnz, distance, length);
+  }
+
+  return kohnz_write_fixed_lz77(kohnz, distance, length);
+}
+
+static int longest_match(
+  struct _matcher *matcher,
+  int pos,
+  int chain,
+  int64_t history,
+  int *distance,
+  struct _match *matches,
+  int *count)
+{
+  const uint8_t *window = matcher->window;
+  const uint8_t *current = window + pos;
+  int max_length = matcher->end - pos;
+  int max_chain = matcher->max_chain;
+  int best_length = MATCHER_MIN_LENGTH - 1;
+  int limit;
+
+  if (max_length > MATCHER_MAX_LENGTH) { max_length = MATCHER_MAX_LENGTH; }
+
+  if (history > MATCHER_WINDOW) { history = MATCHER_WINDOW; }
+
+  limit = pos - (int)history;
+
+  while (chain > limit && chain > 0 && max_chain-- > 0)
+  {
+    const uint8_t *match = window + chain;
+
+    // After a rollback the chains can still have positions that were
+    // thrown away.
+    if (chain >= pos)
+    {
+      chain = matcher->prev[chain & WINDOW_MASK];
+      continue;
+    }
+
+    if (match[best_length] == current[best_length] &&
+        match[0] == current[0] &&
+        match[1] == current[1])
+    {
+      int length = 2;
+
+      while (length < max_length && match[length] == current[length])
+      {
+        length++;
+      }
+
+      if (length > best_length)
+      {
+        best_length = length;
+        *distance = pos - chain;
+
+        // The chain goes from closest to furthest, so every length
+        // between the last match kept and this one is closest here.
+        if (matches != NULL)
+        {
+          if (*count == OPTIMAL_MATCHES) { *count -= 1; }
+
+          matches[*count].length = length;
+          matches[*count].distance = *distance;
+          *count += 1;
+        }
+
+        if (length >= matcher->nice_length || length == max_length) { break; }
+      }
+    }
+
+    chain = matcher->prev[chain & WINDOW_MASK];
+  }
+
+  if (best_length == MATCHER_MIN_LENGTH && *distance > TOO_FAR) { return 0; }
+  if (best_length < MATCHER_MIN_LENGTH) { return 0; }
+
+  return best_length;
+}
+
+static int scan(struct _kohnz *kohnz, struct _matcher *matcher, int lazy)
+{
+  const uint8_t *window = matcher->window;
+  int literals = matcher->pos;
+  int pos = matcher->pos;
+  int length, distance = 0;
+  int64_t history;
+
+  while (pos < matcher->end)
+  {
+    // Positions skipped over by a match (or that were too close to the
+    // end of the data last time) still need to be hashed.
+    while (matcher->hash_pos < pos &&
+           matcher->hash_pos + MATCHER_MIN_LENGTH <= matcher->end)
+    {
+      insert_hash(matcher, matcher->hash_pos++);
+    }
+
+    if (pos + MATCHER_MIN_LENGTH > matcher->end)
+    {
+      pos = matcher->end;
+      break;
+    }
+
+    const int chain = insert_hash(matcher, pos);
+    matcher->hash_pos = pos + 1;
+
+    // Matches can't go back before a full flush or the start of the
+    // file.  Literals that haven't been written yet count as history.
+    history = (int64_t)kohnz->file_size + (pos - literals) - kohnz->window_start;
+
+    length = longest_match(matcher, pos, chain, history, &distance, NULL, NULL);
+
+    if (length == 0)
+    {
+      pos++;
+      continue;
+    }
+
+    // If the next byte starts a longer match, this byte is written as
+    // a literal instead and the same check is done from there.
+    while (lazy == 1 &&
+           length < matcher->nice_length &&
+           pos + 1 + MATCHER_MIN_LENGTH <= matcher->end)
+    {
+      int next_length, next_distance = 0;
+
+      const int next_chain = insert_hash(matcher, pos + 1);
+      matcher->hash_pos = pos + 2;
+
+      next_length = longest_match(
+        matcher, pos + 1, next_chain, history + 1, &next_distance, NULL, NULL);
+
+      if (next_length <= length) { break; }
+
+      pos++;
+      history++;
+      length = next_length;
+      distance = next_distance;
+    }
+
+    if (emit_literals(kohnz, matcher, window + literals, pos - literals) != 0)
+    {
+      return -1;
+    }
+
+    if (emit_match(kohnz, matcher, distance, length) != 0) { return -1; }
+
+    pos += length;
+    literals = pos;
+  }
+
+  matcher->pos = pos;
+
+  return emit_literals(kohnz, matcher, window + literals, pos - literals);
+}
+
+static void costs_fixed(struct _optimal *optimal)
+{
+  int n;
+
+  for (n = 0; n < 256; n++)
+  {
+    optimal->literal_cost[n] = n <= 143 ? 8 : 9;
+  }
+
+  for (n = MATCHER_MIN_LENGTH; n <= MATCHER_MAX_LENGTH; n++)
+  {
+    optimal->length_cost[n] =
+      (deflate_length_table[n].code <= 279 ? 7 : 8) +
+      deflate_length_table[n].extra_bits;
+  }
+
+  for (n = 0; n < 30; n++)
+  {
+    optimal->distance_cost[n] = 5 + deflate_distance_extra_bits[n];
+  }
+}
+
+static void costs_table(
+  struct _optimal *optimal,
+  const struct _kohnz_table *table)
+{
+  int n;
+
+  // Symbols without a code can't be written at all.
+  for (n = 0; n < 256; n++)
+  {
+    optimal->literal_cost[n] =
+      table->literals[n].length == 0 ?
+        OPTIMAL_INFINITE : table->literals[n].length;
+  }
+
+  for (n = MATCHER_MIN_LENGTH; n <= MATCHER_MAX_LENGTH; n++)
+  {
+    const int code = deflate_length_table[n].code;
+
+    optimal->length_cost[n] =
+      table->literals[code].length == 0 ? OPTIMAL_INFINITE :
+        table->literals[code].length + deflate_length_table[n].extra_bits;
+  }
+
+  for (n = 0; n < 30; n++)
+  {
+    optimal->distance_cost[n] =
+      table->distances[n].length == 0 ? OPTIMAL_INFINITE :
+        table->distances[n].length + deflate_distance_extra_bits[n];
+  }
+}
+
+static void find_matches(
+  struct _kohnz *kohnz,
+  struct _matcher *matcher,
+  int pos,
+  int length)
+{
+  struct _optimal *optimal = matcher->optimal;
+  int n, chain, count, distance;
+  int skip = 0;
+
+  // Nothing in this piece has been written yet, so the history only
+  // grows by one for each byte into it.
+  const int64_t history = (int64_t)kohnz->file_size - kohnz->window_start;
+
+  for (n = 0; n < length; n++)
+  {
+    const int current = pos + n;
+
+    while (matcher->hash_pos < current &&
+           matcher->hash_pos + MATCHER_MIN_LENGTH <= matcher->end)
+    {
+      insert_hash(matcher, matcher->hash_pos++);
+    }
+
+    optimal->count[n] = 0;
+
+    if (current + MATCHER_MIN_LENGTH > matcher->end) { continue; }
+
+    // The end of the last piece gets parsed again and is already hashed.
+    if (current < matcher->hash_pos)
+    {
+      chain = matcher->prev[current & WINDOW_MASK];
+    }
+      else
+    {
+      chain = insert_hash(matcher, current);
+      matcher->hash_pos = current + 1;
+    }
+
+    // Inside a match that was already long enough there is nothing
+    // better to find, so those bytes are only hashed.
+    if (skip > 0)
+    {
+      skip--;
+      continue;
+    }
+
+    count = 0;
+
+    longest_match(
+      matcher,
+      current,
+      chain,
+      history + n,
+      &distance,
+      optimal->matches[n],
+      &count);
+
+    optimal->count[n] = count;
+
+    if (count != 0 && optimal->matches[n][count - 1].length >= matcher->nice_length)
+    {
+      skip = optimal->matches[n][count - 1].length - 1;
+    }
+  }
+}
+
+static int optimal_parse(struct _optimal *optimal, const uint8_t *data, int length)
+{
+  uint32_t *cost = optimal->cost;
+  uint32_t next;
+  int n, k, step;
+
+  cost[0] = 0;
+
+  for (n = 1; n <= length; n++) { cost[n] = OPTIMAL_INFINITE; }
+
+  for (n = 0; n < length; n++)
+  {
+    const struct _match *matches = optimal->matches[n];
+    int shortest = MATCHER_MIN_LENGTH;
+
+    if (cost[n] == OPTIMAL_INFINITE) { continue; }
+
+    if (optimal->literal_cost[data[n]] != OPTIMAL_INFINITE)
+    {
+      next = cost[n] + optimal->literal_cost[data[n]];
+
+      if (next < cost[n + 1])
+      {
+        cost[n + 1] = next;
+        optimal->step[n + 1] = 1;
+      }
+    }
+
+    // Every length from the end of the last match kept up to this one
+    // can use this match's distance.
+    for (k = 0; k < optimal->count[n]; k++)
+    {
+      const int distance = matches[k].distance;
+      const uint32_t distance_cost =
+        optimal->distance_cost[deflate_distance_lookup(distance)];
+      int longest = matches[k].length;
+
+      if (longest > length - n) { longest = length - n; }
+
+      if (distance_cost != OPTIMAL_INFINITE)
+      {
+        for (step = shortest; step <= longest; step++)
+        {
+          if (optimal->length_cost[step] == OPTIMAL_INFINITE) { continue; }
+
+          next = cost[n] + optimal->length_cost[step] + distance_cost;
+
+          if (next < cost[n + step])
+          {
+            cost[n + step] = next;
+            optimal->step[n + step] = step;
+            optimal->distance[n + step] = distance;
+          }
+        }
+      }
+
+      shortest = matches[k].length + 1;
+    }
+  }
+
+  if (cost[length] == OPTIMAL_INFINITE) { return -1; }
+
+  // Walk back from the end, path[] ends up with the end of each literal
+  // or match in reverse order.
+  optimal->path_length = 0;
+
+  for (n = length; n > 0; n -= optimal->step[n])
+  {
+    optimal->path[optimal->path_length++] = n;
+  }
+
+  return 0;
+}
+
+static void optimal_histogram(struct _optimal *optimal, const uint8_t *data)
+{
+  int n;
+
+  kohnz_histogram_init(&optimal->histogram);
+
+  for (n = optimal->path_length - 1; n >= 0; n--)
+  {
+    const int end = optimal->path[n];
+    const int step = optimal->step[end];
+
+    if (step == 1)
+    {
+      optimal->histogram.literals[data[end - 1]]++;
+    }
+      else
+    {
+      kohnz_histogram_add_match(
+        &optimal->histogram,
+        optimal->distance[end],
+        step);
+    }
+  }
+}
+
+static int optimal_cut(struct _optimal *optimal, int limit)
+{
+  int cut = 0;
+  int n;
+
+  // The last literal or match that ends by limit.
+  for (n = optimal->path_length - 1; n >= 0; n--)
+  {
+    if (optimal->path[n] > limit) { break; }
+
+    cut = optimal->path[n];
+  }
+
+  return cut;
+}
+
+static int optimal_emit(
+  struct _kohnz *kohnz,
+  struct _matcher *matcher,
+  const uint8_t *data,
+  int length)
+{
+  struct _optimal *optimal = matcher->optimal;
+  int literals = 0;
+  int n;
+
+  for (n = optimal->path_length - 1; n >= 0; n--)
+  {
+    const int end = optimal->path[n];
+    const int step = optimal->step[end];
+
+    if (end > length) { break; }
+    if (step == 1) { continue; }
+
+    if (emit_literals(kohnz, matcher, data + literals, end - step - literals) != 0)
+    {
+      return -1;
+    }
+
+    if (emit_match(kohnz, matcher, optimal->distance[end], step) != 0)
+    {
+      return -1;
+    }
+
+    literals = end;
+  }
+
+  return emit_literals(kohnz, matcher, data + literals, length - literals);
+}
+
+static int scan_optimal(struct _kohnz *kohnz, struct _matcher *matcher)
+{
+  struct _optimal *optimal = matcher->optimal;
+  int pos = matcher->pos;
+  int length;
+
+  while (pos < matcher->end)
+  {
+    const uint8_t *data = matcher->window + pos;
+
+    length = matcher->end - pos;
+
+    if (length > OPTIMAL_SIZE) { length = OPTIMAL_SIZE; }
+
+    find_matches(kohnz, matcher, pos, length);
+
+    // Dynamic blocks already have their codes.  Auto blocks build a
+    // table from the symbols when the block ends, so after a pass with
+    // the fixed codes the piece is parsed again with codes built from
+    // what that pass picked.
+    if (matcher->histogram == NULL && kohnz->mode == MODE_DYNAMIC_HUFFMAN)
+    {
+      costs_table(optimal, kohnz->table);
+    }
+      else
+    {
+      costs_fixed(optimal);
+    }
+
+    if (optimal_parse(optimal, data, length) != 0) { return -1; }
+
+    if (matcher->histogram == NULL && kohnz->mode == MODE_AUTO)
+    {
+      optimal_histogram(optimal, data);
+
+      if (kohnz_table_build(&optimal->table, &optimal->histogram) != 0)
+      {
+        return -1;
+      }
+
+      costs_table(optimal, &optimal->table);
+
+      if (optimal_parse(optimal, data, length) != 0) { return -1; }
+    }
+
+    // Matches near the end of the piece are cut short, so unless this
+    // is all the data there is the last part is parsed again with the
+    // next piece.
+    if (pos + length < matcher->end)
+    {
+      length = optimal_cut(optimal, length - MATCHER_MAX_LENGTH);
+    }
+
+    if (optimal_emit(kohnz, matcher, data, length) != 0) { return -1; }
+
+    pos += length;
+  }
+
+  matcher->pos = pos;
+
+  return 0;
+}
+
+struct _matcher *matcher_create(const struct _kohnz_allocator *allocator)
+{
+  struct _matcher *matcher;
+
+  matcher = (struct _matcher *)kohnz_alloc(allocator, sizeof(struct _matcher));
+
+  if (matcher == NULL) { return NULL; }
+
+  matcher->max_chain = 32;
+  matcher->nice_length = 128;
+  matcher->histogram = NULL;
+  matcher->allocator = *allocator;
+  matcher->optimal = NULL;
+  matcher->slides = 0;
+
+  matcher_reset(matcher);
+
+  return matcher;
+}
+
+void matcher_destroy(struct _matcher *matcher)
+{
+  struct _kohnz_allocator allocator;
+
+  if (matcher == NULL) { return; }
+
+  allocator = matcher->allocator;
+
+  kohnz_free(&allocator, matcher->optimal);
+  kohnz_free(&allocator, matcher);
+}
+
+void matcher_reset(struct _matcher *matcher)
+{
+  matcher->pos = 0;
+  matcher->end = 0;
+  matcher->hash_pos = 0;
+  matcher->file_size = 0;
+
+  // Positions from before a reset don't mean the same thing after it.
+  matcher->slides++;
+
+  memset(matcher->head, 0, sizeof(matcher->head));
+}
+
+void matcher_rollback(
+  struct _matcher *matcher,
+  int pos,
+  int end,
+  int hash_pos,
+  uint64_t file_size)
+{
+  // The window past end gets written over by new data.  Hash chain
+  // entries for those positions are skipped by longest_match() until
+  // they are hashed again.
+  matcher->pos = pos;
+  matcher->end = end;
+  matcher->hash_pos = hash_pos;
+  matcher->file_size = file_size;
+}
+
+void matcher_prime(
+  struct _matcher *matcher,
+  const uint8_t *data,
+  int length,
+  uint64_t file_size)
+{
+  // Only the last 32k can be referenced.
+  if (length > MATCHER_WINDOW)
+  {
+    data += length - MATCHER_WINDOW;
+    length = MATCHER_WINDOW;
+  }
+
+  matcher_reset(matcher);
+
+  // Position 0 marks the end of a hash chain, so start the data at 1.
+  memcpy(matcher->window + 1, data, length);
+
+  matcher->pos = length + 1;
+  matcher->end = length + 1;
+  matcher->hash_pos = 1;
+  matcher->file_size = file_size;
+}
+
+int matcher_compress(
+  struct _kohnz *kohnz,
+  struct _matcher *matcher,
+  const uint8_t *data,
+  int length)
+{
+  const struct _level *level = &levels[kohnz->level];
+  int count;
+  int ret;
+
+  matcher->max_chain = level->max_chain;
+  matcher->nice_length = level->nice_length;
+
+  if (kohnz->level == KOHNZ_LEVEL_OPTIMAL && matcher->optimal == NULL)
+  {
+    matcher->optimal = (struct _optimal *)kohnz_alloc(
+      &matcher->allocator,
+      sizeof(struct _optimal));
+
+    if (matcher->optimal == NULL) { return -1; }
+  }
+
+  // Data written with kohnz_write_*(), kohnz_append() or spliced in by
+  // kohnz_compress_parallel() never went through the window, so the
+  // distances to what is in it are wrong now.  Start over.
+  if (matcher->end != 0 && matcher->file_size != kohnz->file_size)
+  {
+    matcher_reset(matcher);
+  }
+
+  while (length > 0)
+  {
+    if (matcher->end == MATCHER_WINDOW * 2) { slide(matcher); }
+
+    count = MATCHER_WINDOW * 2 - matcher->end;
+
+    if (count > length) { count = length; }
+
+    memcpy(matcher->window + matcher->end, data, count);
+    matcher->end += count;
+
+    data += count;
+    length -= count;
+
+    if (kohnz->level == KOHNZ_LEVEL_OPTIMAL)
+    {
+      ret = scan_optimal(kohnz, matcher);
+    }
+      else
+    {
+      ret = scan(kohnz, matcher, kohnz->level == KOHNZ_LEVEL_LAZY);
+    }
+
+    if (ret != 0) { return -1; }
+  }
+
+  matcher->file_size = kohnz->file_size;
+
+  return 0;
+}
+
@@ -0,0 +1,74 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ */
+
+#ifndef _MATCHER_H
+#define _MATCHER_H
+
+#include <stdint.h>
+
+#include "kohnz.h"
+
+#define MATCHER_WINDOW 32768
+#define MATCHER_HASH_BITS 15
+#define MATCHER_HASH_SIZE (1 << MATCHER_HASH_BITS)
+#define MATCHER_MIN_LENGTH 3
+#define MATCHER_MAX_LENGTH 258
+
+struct _optimal;
+
+// Hash chains over a 64k window.  Positions are offsets into window[]
+// and 0 is used to mark the end of a chain.  When the window fills up
+// the top half is slid down and all positions drop by MATCHER_WINDOW.
+struct _matcher
+{
+  int pos;
+  int end;
+  int hash_pos;
+  int slides;
+  int max_chain;
+  int nice_length;
+  // The context's file_size that the end of the window lines up with.
+  // Only checked while the window isn't empty.
+  uint64_t file_size;
+  struct _kohnz_histogram *histogram;
+  struct _kohnz_allocator allocator;
+  // Only allocated the first time KOHNZ_LEVEL_OPTIMAL is used.
+  struct _optimal *optimal;
+  uint16_t head[MATCHER_HASH_SIZE];
+  uint16_t prev[MATCHER_WINDOW];
+  uint8_t window[MATCHER_WINDOW * 2];
+};
+
+struct _matcher *matcher_create(const struct _kohnz_allocator *allocator);
+void matcher_destroy(struct _matcher *matcher);
+void matcher_reset(struct _matcher *matcher);
+
+void matcher_rollback(
+  struct _matcher *matcher,
+  int pos,
+  int end,
+  int hash_pos,
+  uint64_t file_size);
+
+void matcher_prime(
+  struct _matcher *matcher,
+  const uint8_t *data,
+  int length,
+  uint64_t file_size);
+
+int matcher_compress(
+  struct _kohnz *kohnz,
+  struct _matcher *matcher,
+  const uint8_t *data,
+  int length);
+
+#endif
+
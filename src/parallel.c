@@ -0,0 +1,228 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "alloc.h"
+#include "kohnz.h"
+#include "matcher.h"
+#include "parallel.h"
+
+static int compress_chunk(
+  struct _parallel *parallel,
+  struct _matcher *matcher,
+  int index)
+{
+  struct _chunk *chunk = &parallel->chunks[index];
+  const uint64_t start = (uint64_t)index * parallel->chunk_size;
+  int length = parallel->chunk_size;
+  int history;
+
+  if (start + length > parallel->length) { length = parallel->length - start; }
+
+  // Like pigz, the 32k before the chunk is used as a dictionary.  The
+  // chunks all end up in the same stream so distances into it are valid.
+  history = start > MATCHER_WINDOW ? MATCHER_WINDOW : start;
+
+  chunk->kohnz = kohnz_open_memory_with(parallel->allocator);
+
+  if (chunk->kohnz == NULL) { return -1; }
+
+  matcher_prime(
+    matcher,
+    parallel->data + start - history,
+    history,
+    chunk->kohnz->file_size);
+
+  chunk->kohnz->window_start = -history;
+  chunk->kohnz->container = parallel->container;
+  chunk->kohnz->level = parallel->level;
+
+  kohnz_start_fixed_block(chunk->kohnz, 0);
+
+  if (matcher_compress(chunk->kohnz, matcher, parallel->data + start, length) != 0)
+  {
+    return -1;
+  }
+
+  kohnz_end_fixed_block(chunk->kohnz);
+
+  kohnz_build_crc32(chunk->kohnz, parallel->data + start, length);
+
+  return 0;
+}
+
+static void *worker(void *context)
+{
+  struct _parallel *parallel = (struct _parallel *)context;
+  struct _matcher *matcher;
+  int index, ret;
+
+  matcher = matcher_create(parallel->allocator);
+
+  pthread_mutex_lock(&parallel->lock);
+
+  if (matcher == NULL) { parallel->error = 1; }
+
+  while (parallel->error == 0 && parallel->next_chunk < parallel->chunk_count)
+  {
+    index = parallel->next_chunk;
+
+    // Don't get too far ahead of the thread writing chunks out.
+    if (index >= parallel->written + parallel->max_pending)
+    {
+      pthread_cond_wait(&parallel->cond, &parallel->lock);
+      continue;
+    }
+
+    parallel->next_chunk++;
+
+    pthread_mutex_unlock(&parallel->lock);
+
+    ret = compress_chunk(parallel, matcher, index);
+
+    pthread_mutex_lock(&parallel->lock);
+
+    if (ret != 0) { parallel->error = 1; }
+
+    parallel->chunks[index].done = 1;
+
+    pthread_cond_broadcast(&parallel->cond);
+  }
+
+  pthread_cond_broadcast(&parallel->cond);
+  pthread_mutex_unlock(&parallel->lock);
+
+  matcher_destroy(matcher);
+
+  return NULL;
+}
+
+int kohnz_compress_parallel(
+  struct _kohnz *kohnz,
+  const uint8_t *data,
+  uint64_t length,
+  int threads,
+  int chunk_size)
+{
+  struct _parallel parallel;
+  pthread_t *thread_ids;
+  int count = 0;
+  int n, ret;
+
+  // Chunks are written as complete blocks, so this has to be called
+  // between blocks.
+  if (kohnz->container == KOHNZ_CONTAINER_BGZF) { return -1; }
+  if (kohnz->in_block != 0 || kohnz->is_final != 0) { return -1; }
+  if (length == 0) { return 0; }
+
+  if (threads <= 0) { threads = sysconf(_SC_NPROCESSORS_ONLN); }
+  if (threads <= 0) { threads = 1; }
+  if (chunk_size <= 0) { chunk_size = PARALLEL_CHUNK_SIZE; }
+
+  memset(&parallel, 0, sizeof(parallel));
+
+  parallel.data = data;
+  parallel.container = kohnz->container;
+  parallel.level = kohnz->level;
+  parallel.allocator = &kohnz->allocator;
+  parallel.length = length;
+  parallel.chunk_size = chunk_size;
+  parallel.chunk_count = (length + chunk_size - 1) / chunk_size;
+  parallel.max_pending = threads * 2;
+
+  parallel.chunks = (struct _chunk *)kohnz_alloc(
+    &kohnz->allocator,
+    sizeof(struct _chunk) * parallel.chunk_count);
+  thread_ids = (pthread_t *)kohnz_alloc(
+    &kohnz->allocator,
+    sizeof(pthread_t) * threads);
+
+  if (parallel.chunks == NULL || thread_ids == NULL)
+  {
+    kohnz_free(&kohnz->allocator, parallel.chunks);
+    kohnz_free(&kohnz->allocator, thread_ids);
+    return -1;
+  }
+
+  memset(parallel.chunks, 0, sizeof(struct _chunk) * parallel.chunk_count);
+
+  pthread_mutex_init(&parallel.lock, NULL);
+  pthread_cond_init(&parallel.cond, NULL);
+
+  for (n = 0; n < threads; n++)
+  {
+    if (pthread_create(&thread_ids[n], NULL, worker, &parallel) != 0) { break; }
+    count++;
+  }
+
+  if (count == 0) { parallel.error = 1; }
+
+  // Write chunks out in order as they finish.
+  pthread_mutex_lock(&parallel.lock);
+
+  for (n = 0; n < parallel.chunk_count && parallel.error == 0; n++)
+  {
+    while (parallel.chunks[n].done == 0 && parallel.error == 0)
+    {
+      pthread_cond_wait(&parallel.cond, &parallel.lock);
+    }
+
+    if (parallel.error != 0) { break; }
+
+    pthread_mutex_unlock(&parallel.lock);
+
+    // Chunks are spliced in at the bit level with their CRCs combined.
+    ret = kohnz_append(kohnz, parallel.chunks[n].kohnz);
+
+    kohnz_close(parallel.chunks[n].kohnz);
+    parallel.chunks[n].kohnz = NULL;
+
+    pthread_mutex_lock(&parallel.lock);
+
+    // The workers read error while holding the lock, so it's only set
+    // while holding it too.
+    if (ret != 0) { parallel.error = 1; }
+
+    parallel.written = n + 1;
+
+    pthread_cond_broadcast(&parallel.cond);
+  }
+
+  pthread_cond_broadcast(&parallel.cond);
+  pthread_mutex_unlock(&parallel.lock);
+
+  for (n = 0; n < count; n++)
+  {
+    pthread_join(thread_ids[n], NULL);
+  }
+
+  for (n = 0; n < parallel.chunk_count; n++)
+  {
+    if (parallel.chunks[n].kohnz != NULL)
+    {
+      kohnz_close(parallel.chunks[n].kohnz);
+    }
+  }
+
+  pthread_mutex_destroy(&parallel.lock);
+  pthread_cond_destroy(&parallel.cond);
+
+  kohnz_free(&kohnz->allocator, parallel.chunks);
+  kohnz_free(&kohnz->allocator, thread_ids);
+
+  return parallel.error == 0 ? 0 : -1;
+}
+
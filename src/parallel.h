@@ -0,0 +1,47 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ */
+
+#ifndef _PARALLEL_H
+#define _PARALLEL_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "kohnz.h"
+
+#define PARALLEL_CHUNK_SIZE (128 * 1024)
+
+struct _chunk
+{
+  struct _kohnz *kohnz;
+  int done;
+};
+
+struct _parallel
+{
+  const uint8_t *data;
+  uint64_t length;
+  int chunk_size;
+  int chunk_count;
+  int container;
+  int level;
+  const struct _kohnz_allocator *allocator;
+  int next_chunk;
+  int written;
+  int max_pending;
+  int error;
+  struct _chunk *chunks;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+#endif
+
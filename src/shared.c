@@ -0,0 +1,218 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#include "alloc.h"
+#include "crc32.h"
+#include "fileio.h"
+#include "kohnz.h"
+#include "shared.h"
+
+static void drain(struct _kohnz_shared *shared)
+{
+  struct _shared_slot *slot;
+  uint64_t ticket;
+
+  while (1)
+  {
+    // Only one thread writes to the file at a time.  Anyone else just
+    // leaves their record in its slot for that thread to pick up.
+    if (atomic_flag_test_and_set(&shared->draining)) { return; }
+
+    ticket = atomic_load(&shared->drain_ticket);
+
+    while (1)
+    {
+      slot = &shared->slots[ticket % shared->slot_count];
+
+      if (atomic_load(&slot->ready) == 0) { break; }
+
+      if (write_bit_stream(
+        shared->kohnz,
+        slot->buffer,
+        slot->length,
+        &slot->bits) != 0)
+      {
+        atomic_store(&shared->error, 1);
+      }
+
+      shared->crc32 =
+        kohnz_crc32_combine(shared->crc32, slot->crc32, slot->file_size);
+      shared->kohnz->file_size += slot->file_size;
+
+      slot->length = 0;
+
+      atomic_store(&slot->ready, 0);
+      atomic_store(&slot->ticket, ticket + shared->slot_count);
+
+      ticket++;
+    }
+
+    atomic_store(&shared->drain_ticket, ticket);
+    atomic_flag_clear(&shared->draining);
+
+    // A record could have been marked ready after the check above but
+    // before the flag was cleared, in which case its thread gave up.
+    slot = &shared->slots[ticket % shared->slot_count];
+
+    if (atomic_load(&slot->ready) == 0) { return; }
+  }
+}
+
+struct _kohnz_shared *kohnz_shared_open(
+  const char *filename,
+  const char *fname,
+  const char *fcomment,
+  int slot_count)
+{
+  struct _kohnz_allocator allocator;
+  struct _kohnz_shared *shared;
+  int n;
+
+  if (slot_count <= 0) { slot_count = 64; }
+
+  kohnz_allocator_get(&allocator);
+
+  shared = (struct _kohnz_shared *)kohnz_alloc(
+    &allocator,
+    sizeof(struct _kohnz_shared));
+
+  if (shared == NULL) { return NULL; }
+
+  memset(shared, 0, sizeof(struct _kohnz_shared));
+
+  shared->allocator = allocator;
+
+  atomic_flag_clear(&shared->draining);
+
+  shared->slot_count = slot_count;
+  shared->slots = (struct _shared_slot *)kohnz_alloc(
+    &shared->allocator,
+    sizeof(struct _shared_slot) * slot_count);
+
+  if (shared->slots == NULL)
+  {
+    kohnz_free(&allocator, shared);
+    return NULL;
+  }
+
+  memset(shared->slots, 0, sizeof(struct _shared_slot) * slot_count);
+
+  for (n = 0; n < slot_count; n++)
+  {
+    atomic_store(&shared->slots[n].ticket, n);
+  }
+
+  shared->kohnz = kohnz_open(filename, fname, fcomment);
+
+  if (shared->kohnz == NULL)
+  {
+    kohnz_free(&allocator, shared->slots);
+    kohnz_free(&allocator, shared);
+    return NULL;
+  }
+
+  return shared;
+}
+
+int kohnz_shared_commit(struct _kohnz_shared *shared, struct _kohnz *record)
+{
+  struct _shared_slot *slot;
+  uint8_t *buffer;
+  uint64_t ticket;
+  int size;
+
+  // Records are a series of closed, non-final blocks that were written
+  // to a memory context.  They get spliced into the file at whatever bit
+  // the previous record ended on.
+  if (record->is_memory == 0) { return -1; }
+  if (record->in_block != 0 || record->is_final != 0) { return -1; }
+
+  // Buffers are traded between records and slots and freed by whichever
+  // ends up with them, so they all have to come from the same allocator.
+  if (kohnz_allocator_equal(&record->allocator, &shared->allocator) == 0)
+  {
+    return -1;
+  }
+
+  if (record->buffer_length == 0 && record->bits.length == 0)
+  {
+    return 0;
+  }
+
+  ticket = atomic_fetch_add(&shared->next_ticket, 1);
+  slot = &shared->slots[ticket % shared->slot_count];
+
+  // The ring is full, so help write out records until this slot frees up.
+  while (atomic_load(&slot->ticket) != ticket)
+  {
+    drain(shared);
+    sched_yield();
+  }
+
+  // Trade buffers with the slot instead of copying.
+  buffer = slot->buffer;
+  size = slot->size;
+
+  slot->buffer = record->buffer;
+  slot->size = record->buffer_size;
+  slot->length = record->buffer_length;
+  slot->bits = record->bits;
+  slot->crc32 = record->crc32 ^ 0xffffffff;
+  slot->file_size = record->file_size;
+
+  record->buffer = buffer;
+  record->buffer_size = size;
+
+  atomic_store(&slot->ready, 1);
+
+  kohnz_reset(record);
+
+  drain(shared);
+
+  return atomic_load(&shared->error) == 0 ? 0 : -1;
+}
+
+int kohnz_shared_close(struct _kohnz_shared *shared)
+{
+  struct _kohnz_allocator allocator = shared->allocator;
+  int ret;
+  int n;
+
+  drain(shared);
+
+  if (atomic_load(&shared->next_ticket) != atomic_load(&shared->drain_ticket))
+  {
+    // A commit is still in progress on another thread.
+    atomic_store(&shared->error, 1);
+  }
+
+  shared->kohnz->crc32 = shared->crc32 ^ 0xffffffff;
+
+  ret = kohnz_close(shared->kohnz);
+
+  if (atomic_load(&shared->error) != 0) { ret = -1; }
+
+  for (n = 0; n < shared->slot_count; n++)
+  {
+    kohnz_free(&allocator, shared->slots[n].buffer);
+  }
+
+  kohnz_free(&allocator, shared->slots);
+  kohnz_free(&allocator, shared);
+
+  return ret;
+}
+
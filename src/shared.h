@@ -0,0 +1,49 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ */
+
+#ifndef _SHARED_H
+#define _SHARED_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "kohnz.h"
+
+// A slot is free for the record with a given ticket when slot->ticket
+// matches it.  Once the record is copied in ready is set, and after it's
+// written to the file ticket is moved ahead by slot_count.
+struct _shared_slot
+{
+  _Atomic uint64_t ticket;
+  _Atomic int ready;
+  uint8_t *buffer;
+  int length;
+  int size;
+  struct _bits bits;
+  uint32_t crc32;
+  uint64_t file_size;
+};
+
+struct _kohnz_shared
+{
+  struct _kohnz *kohnz;
+  struct _shared_slot *slots;
+  int slot_count;
+  _Atomic uint64_t next_ticket;
+  _Atomic uint64_t drain_ticket;
+  _Atomic int error;
+  atomic_flag draining;
+  uint32_t crc32;
+  struct _kohnz_allocator allocator;
+};
+
+#endif
+
@@ -0,0 +1,66 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ */
+
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdint.h>
+
+#include "kohnz.h"
+
+// Counters are only compiled in when building with -DKOHNZ_STATS (and
+// cycle counts with -DKOHNZ_STATS_CYCLES too).  Otherwise all of these
+// expand to nothing.
+
+#if defined(KOHNZ_STATS_CYCLES) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define STATS_CYCLES() __rdtsc()
+#else
+#define STATS_CYCLES() 0
+#endif
+
+#ifdef KOHNZ_STATS
+
+struct _stats_mark
+{
+  uint64_t bits;
+  uint64_t cycles;
+};
+
+// Bits written since the context was opened, including what's still
+// in the buffer and holding register.
+#define STATS_BIT_POSITION(kohnz) \
+  (((kohnz)->stats.bytes_flushed + (kohnz)->buffer_length) * 8 + \
+    (kohnz)->bits.length)
+
+#define STATS_ADD(kohnz, field, value) ((kohnz)->stats.field += (value))
+
+#define STATS_BEGIN(kohnz) \
+  struct _stats_mark stats_mark = \
+    { STATS_BIT_POSITION(kohnz), STATS_CYCLES() }
+
+#define STATS_END(kohnz, bits_field) \
+  do \
+  { \
+    (kohnz)->stats.bits_field += STATS_BIT_POSITION(kohnz) - stats_mark.bits; \
+    (kohnz)->stats.encode_cycles += STATS_CYCLES() - stats_mark.cycles; \
+  } while (0)
+
+#else
+
+#define STATS_ADD(kohnz, field, value)
+#define STATS_BEGIN(kohnz)
+#define STATS_END(kohnz, bits_field)
+
+#endif
+
+#endif
+
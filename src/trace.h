@@ -0,0 +1,82 @@
+/**
+ *  libkohnz
+ *  Author: Michael Kohn
+ *   Email: mike@mikekohn.net
+ *     Web: http://www.mikekohn.net/
+ * License: GPLv3
+ *
+ * Copyright 2018-2019 by Michael Kohn
+ *
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdint.h>
+#include <time.h>
+
+// USDT probes (provider "kohnz") are compiled in whenever <sys/sdt.h>
+// is available, unless building with -DKOHNZ_NO_TRACE.  A probe is a
+// single nop until a tracer attaches to it.  Latency arguments are in
+// nanoseconds and only measured around calls that do I/O, and only
+// while a tracer is attached to that probe (the tracer sets the probe's
+// semaphore), so the clock isn't read on every write otherwise.
+//
+//   block_start(mode, is_final, file_size)
+//   block_end(mode, file_size)
+//   flush(flush_type, file_size, ns)
+//   close(file_size, ns)
+//   buffer_flush(length, ns)
+//   write_direct(length, ns)
+
+#if !defined(KOHNZ_NO_TRACE) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define KOHNZ_TRACE
+#endif
+#endif
+
+#ifdef KOHNZ_TRACE
+
+// Each probe has a counter the tracer increments while it's attached.
+// They are defined once in kohnz.c with TRACE_SEMAPHORE().
+#define TRACE_SEMAPHORE(name) \
+  unsigned short kohnz_##name##_semaphore \
+    __attribute__((unused)) __attribute__((section(".probes")))
+
+extern TRACE_SEMAPHORE(block_start);
+extern TRACE_SEMAPHORE(block_end);
+extern TRACE_SEMAPHORE(flush);
+extern TRACE_SEMAPHORE(close);
+extern TRACE_SEMAPHORE(buffer_flush);
+extern TRACE_SEMAPHORE(write_direct);
+
+static inline uint64_t trace_time_ns()
+{
+  struct timespec tp;
+
+  clock_gettime(CLOCK_MONOTONIC, &tp);
+
+  return (uint64_t)tp.tv_sec * 1000000000 + tp.tv_nsec;
+}
+
+#define TRACE_ENABLED(name) __builtin_expect(kohnz_##name##_semaphore != 0, 0)
+
+// start is 0 when nothing was attached to the probe as the call began.
+#define TRACE_BEGIN(name, start) \
+  const uint64_t start = TRACE_ENABLED(name) ? trace_time_ns() : 0
+#define TRACE_ELAPSED(start) ((start) != 0 ? trace_time_ns() - (start) : 0)
+#define TRACE2(name, a, b) DTRACE_PROBE2(kohnz, name, a, b)
+#define TRACE3(name, a, b, c) DTRACE_PROBE3(kohnz, name, a, b, c)
+
+#else
+
+#define TRACE_BEGIN(name, start)
+#define TRACE2(name, a, b)
+#define TRACE3(name, a, b, c)
+
+#endif
+
+#endif
+